@@ -2,63 +2,18 @@
 #include <SDL3/SDL.h>
 #include <glm/glm.hpp>
 #include "grapher.hpp"
+#include "renderer.hpp"
+#include "scene.hpp"
 
 constexpr int SCR_WIDTH = 1280;
 constexpr int SCR_HEIGHT = 720;
-
-constexpr float PI = 3.14159265359f;
-constexpr float TWOPI = PI * 2.f;
+// Time the render thread spends on each progressive pass before it publishes the frame
+constexpr double FRAME_BUDGET_MS = 12.0;
 
 SDL_Window* window;
 SDL_Surface* surface;
 uint32_t* pixels;
 
-float Linear(const int x, const float c, const float o) {
-    return static_cast<float>(x) * c + o;
-}
-
-float Sine(const int x, const float a, const float b, const float c, const float d) {
-    return a * glm::sin(b * static_cast<float>(x) + c) + d;
-}
-
-float SineSurface(const int x, const int y, const float a, const float b, const float c) {
-    return Sine(x+y, a, b, c, 0.f);
-}
-
-std::pair<float, float> Parametric(const float t, const float o) {
-
-    float x = glm::sin(0.1f * t) * 10.f + t * 1.3f + o;
-    float y = t;
-
-    return {x, y};
-}
-
-std::pair<float, float> Circle(const float t, const float x0, const float y0, const float r) {
-
-    float x = x0 + glm::sin(t) * r;
-    float y = y0 + glm::cos(t) * r;
-
-    return {x, y};
-}
-
-std::tuple<float, float, float> Torus(const float t, const float s, const float R, const float r, const float x0, const float y0) {
-
-    float x = x0 + (R + r * glm::cos(t)) * glm::cos(s);
-    float y = y0 + (R + r * glm::cos(t)) * glm::sin(s);
-    float z = r * glm::sin(t);
-
-    return {x, y, z};
-}
-
-std::tuple<float, float, float> Sphere(const float t, const float s, const float r, const float x0, const float y0) {
-
-    float x = x0 + r * glm::sin(t) * glm::cos(s);
-    float y = y0 + r * glm::sin(t) * glm::sin(s);
-    float z = r * glm::cos(t);
-
-    return {x, y, z};
-}
-
 int main()
 {
     std::cout << "Hello, world!" << std::endl;
@@ -77,104 +32,11 @@ int main()
     pixels = static_cast<uint32_t*>(surface->pixels);
 
     GR::Grapher grapher;
+    grapher.SetWorkerCount(0);
+    // Every edit redraws the whole scene, the cache keeps that to the layers the edit changed
+    grapher.SetLayerCache(true);
 
-    {
-        GR::Grapher::SurfaceInfo info;
-        info.function = std::bind(SineSurface, std::placeholders::_1, std::placeholders::_2, 5.f, 0.1f, 0.f);
-        info.colorlo = 0xffff7f00;
-        info.colorhi = 0xfffe900;
-
-        grapher.AddSurface(info);
-    }
-
-    {
-        GR::Grapher::FunctionInfo info;
-
-        info.color = 0xfffd0000;
-
-        for (int i = 0; i < 25; ++i) {
-            info.function = std::bind(Linear, std::placeholders::_1, 0.f, static_cast<float>(surface->h) - static_cast<float>(i) * (static_cast<float>(i) * 0.07f) * 3.f);
-            grapher.AddFunction(info);
-        }
-    }
-
-    {
-        GR::Grapher::FunctionInfo info;
-
-        info.color = 0xffffd644;
-        info.axis = GR::Axis::Y;
-        info.plot = GR::PlotType::LINE;
-
-        for (int i = 0; i < 7; ++i) {
-            info.function = std::bind(Sine, std::placeholders::_1, 10.f, 0.1f, static_cast<float>(i) * 1.f, 15.f + static_cast<float>(i) * 30.f);
-
-            grapher.AddFunction(info);
-        }
-    }
-
-    {
-        GR::Grapher::EquationInfo info;
-        info.plot = GR::PlotType::LINE;
-        info.color = 0xff23d6ff;
-
-        for (int i = 0; i < 10; ++i) {
-            info.equation = std::bind(Circle, std::placeholders::_1, static_cast<float>(surface->w) * 0.2f + 100.f * static_cast<float>(i), static_cast<float>(surface->h) * 0.75 - 15.f * static_cast<float>(i), 40.f);
-            info.t0 = 0.f;
-            info.tMax = TWOPI + 0.5f * PI;
-            info.tStep = TWOPI / (3.f + static_cast<float>(i));
-
-            grapher.AddEquation(info);
-        }
-
-        info.color = 0xff88ff84;
-
-        info.t0 = 0.f;
-        info.tMax = TWOPI + 0.5f * PI;
-        info.tStep = TWOPI / 3.f;
-        for (int i = 0; i < 9; ++i) {
-            float angle = glm::radians(static_cast<float>(i) * 40.f);
-            info.equation = std::bind(Circle, std::placeholders::_1,
-                SCR_WIDTH * 0.7f + static_cast<float>(i) * glm::cos(angle) * 35.f,
-                SCR_HEIGHT * 0.4f + static_cast<float>(i) * glm::sin(angle) * 35.f,
-                static_cast<float>(i + 1) * 10.f);
-            grapher.AddEquation(info);
-        }
-    }
-
-    {
-        GR::Grapher::ParametricSurfaceInfo info;
-
-
-        info.colorlo = 0xff000000;
-        info.colorhi = 0xffffffff;
-
-        info.t0 = 0.f;
-        info.tMax = TWOPI + 0.5f * PI;
-        info.tStep = TWOPI / 360.f;
-        info.s0 = 0.f;
-        info.sMax = TWOPI + 0.5f * PI;
-        info.sStep = TWOPI / 360.f;
-
-        for (int i = 0; i < 3; ++i) {
-            info.function = std::bind(Sphere, std::placeholders::_1, std::placeholders::_2, 120.f - static_cast<float>(i) * 20.f, SCR_WIDTH * 0.15f + 150.f * static_cast<float>(i), SCR_HEIGHT * 0.15f+ 30.f * static_cast<float>(i));
-
-            grapher.AddParametricSurface(info);
-        }
-    }
-
-    {
-        GR::Grapher::ParametricSurfaceInfo info;
-
-        info.function = std::bind(Torus, std::placeholders::_1, std::placeholders::_2, 100.f, 20.f, SCR_WIDTH * 0.75f, SCR_HEIGHT * 0.75f);
-        info.t0 = 0.f;
-        info.tMax = TWOPI + 0.5f * PI;
-        info.tStep = TWOPI / 360.f;
-        info.s0 = 0.f;
-        info.sMax = TWOPI + 0.5f * PI;
-        info.sStep = TWOPI / 720.f;
-
-        grapher.AddParametricSurface(info);
-    }
+    BuildDemoScene(grapher, surface->w, surface->h);
 
     /*
     {
@@ -255,8 +117,11 @@ int main()
     }
     */
 
+    // Owns the grapher from here on, scene changes go through renderer.Request
+    Renderer renderer(grapher, surface->w, surface->h, FRAME_BUDGET_MS);
+    renderer.Request();
+
     bool running = true;
-    bool draw = true;
 
     while (running)
     {
@@ -267,7 +132,7 @@ int main()
             {
                 case SDL_EVENT_KEY_DOWN:
                     if (event.key.key == SDLK_D) {
-                        draw = true;
+                        renderer.Request();
                     }
                     if (event.key.key == SDLK_ESCAPE) {
                         running = false;
@@ -285,18 +150,16 @@ int main()
             }
         }
         SDL_LockSurface(surface);
+        const bool frame = renderer.TakeFrame(pixels);
+        SDL_UnlockSurface(surface);
 
-        if (draw) {
-            // Clear buffer
-            memset(pixels, 40, SCR_WIDTH * SCR_HEIGHT * 4);
-
-            // Draw in order
-            grapher.DrawAll(static_cast<uint32_t *>(surface->pixels),surface->w, surface->h);
-            draw = false;
+        if (frame) {
+            SDL_UpdateWindowSurface(window);
+        }
+        else {
+            // Nothing new to show, leave the cores to the render thread
+            SDL_Delay(1);
         }
-
-        SDL_UnlockSurface(surface);
-        SDL_UpdateWindowSurface(window);
     }
 
     SDL_DestroyWindow(window);
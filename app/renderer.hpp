@@ -0,0 +1,128 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "grapher.hpp"
+
+// Runs a Grapher on its own thread so the event loop never waits for a frame. Every render goes into a back
+// buffer that is swapped with the front buffer once it is finished; progressive passes are published as they
+// complete. A new request cancels the render in flight, so a stale frame never keeps the CPU busy.
+class Renderer
+{
+public:
+    using Edit = std::function<void(GR::Grapher&)>;
+
+    // The grapher belongs to the render thread from now on, change it through Request
+    Renderer(GR::Grapher& grapher, const int width, const int height, const double budgetMs)
+        : _grapher(grapher), _width(width), _height(height), _budgetMs(budgetMs),
+          _back(static_cast<size_t>(width) * height), _front(static_cast<size_t>(width) * height)
+    {
+        _grapher.SetCancelFlag(&_cancel);
+        _thread = std::jthread([this](const std::stop_token& stop) { Run(stop); });
+    }
+
+    ~Renderer()
+    {
+        {
+            std::lock_guard lock(_mutex);
+            _thread.request_stop();
+            _cancel = true;
+        }
+        _wake.notify_one();
+        _thread.join();
+        _grapher.SetCancelFlag(nullptr);
+    }
+
+    Renderer(const Renderer&) = delete;
+    Renderer& operator=(const Renderer&) = delete;
+
+    // Asks for a new frame, applying `edit` to the grapher on the render thread first. Edits are never dropped,
+    // only the frame they interrupt is.
+    void Request(Edit edit = nullptr)
+    {
+        {
+            std::lock_guard lock(_mutex);
+            if (edit) {
+                _edits.push_back(std::move(edit));
+            }
+            ++_requested;
+            _cancel = true;
+        }
+        _wake.notify_one();
+    }
+
+    // Copies the newest finished frame into pixels, false when there is none since the last call
+    bool TakeFrame(uint32_t* pixels)
+    {
+        std::lock_guard lock(_mutex);
+        if (_published == _taken) {
+            return false;
+        }
+        _taken = _published;
+        std::memcpy(pixels, _front.data(), _front.size() * sizeof(uint32_t));
+        return true;
+    }
+
+private:
+    static constexpr uint32_t BACKGROUND = 0x28282828;
+
+    GR::Grapher& _grapher;
+    const int _width;
+    const int _height;
+    const double _budgetMs;
+
+    std::vector<uint32_t> _back;
+    std::vector<uint32_t> _front;
+
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::atomic<bool> _cancel = false;
+    std::vector<Edit> _edits;
+    uint64_t _requested = 0;
+    uint64_t _rendered = 0;
+    uint64_t _published = 0;
+    uint64_t _taken = 0;
+
+    std::jthread _thread;
+
+    void Run(const std::stop_token& stop)
+    {
+        std::vector<Edit> edits;
+        while (true) {
+            {
+                std::unique_lock lock(_mutex);
+                _wake.wait(lock, [&] { return stop.stop_requested() || _requested != _rendered; });
+                if (stop.stop_requested()) {
+                    return;
+                }
+                // Taking the edits and clearing the flag together means any later request cancels this render
+                edits.swap(_edits);
+                _rendered = _requested;
+                _cancel = false;
+            }
+
+            for (const Edit& edit : edits) {
+                edit(_grapher);
+            }
+            edits.clear();
+
+            bool complete = false;
+            while (!complete) {
+                GR::Clear(_back.data(), _back.size(), BACKGROUND);
+                complete = _grapher.DrawProgressive(_back.data(), _width, _height, _budgetMs);
+
+                std::lock_guard lock(_mutex);
+                if (_cancel) {
+                    break;
+                }
+                _back.swap(_front);
+                ++_published;
+            }
+        }
+    }
+};
\ No newline at end of file
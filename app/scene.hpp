@@ -0,0 +1,163 @@
+#pragma once
+#include <glm/glm.hpp>
+#include "grapher.hpp"
+
+constexpr float PI = 3.14159265359f;
+constexpr float TWOPI = PI * 2.f;
+
+inline float Linear(const int x, const float c, const float o) {
+    return static_cast<float>(x) * c + o;
+}
+
+inline float Sine(const int x, const float a, const float b, const float c, const float d) {
+    return a * glm::sin(b * static_cast<float>(x) + c) + d;
+}
+
+inline float SineSurface(const int x, const int y, const float a, const float b, const float c) {
+    return Sine(x+y, a, b, c, 0.f);
+}
+
+// Row-at-a-time SineSurface, a plain loop the compiler can vectorize instead of one indirect call per pixel
+inline void SineSurfaceRow(const int y, const int x0, const std::span<float> out, const float a, const float b, const float c) {
+    for (size_t i = 0; i < out.size(); ++i) {
+        out[i] = a * glm::sin(b * static_cast<float>(x0 + static_cast<int>(i) + y) + c) + 0.f;
+    }
+}
+
+inline std::pair<float, float> Parametric(const float t, const float o) {
+
+    float x = glm::sin(0.1f * t) * 10.f + t * 1.3f + o;
+    float y = t;
+
+    return {x, y};
+}
+
+inline std::pair<float, float> Circle(const float t, const float x0, const float y0, const float r) {
+
+    float x = x0 + glm::sin(t) * r;
+    float y = y0 + glm::cos(t) * r;
+
+    return {x, y};
+}
+
+inline std::tuple<float, float, float> Torus(const float t, const float s, const float R, const float r, const float x0, const float y0) {
+
+    float x = x0 + (R + r * glm::cos(t)) * glm::cos(s);
+    float y = y0 + (R + r * glm::cos(t)) * glm::sin(s);
+    float z = r * glm::sin(t);
+
+    return {x, y, z};
+}
+
+inline std::tuple<float, float, float> Sphere(const float t, const float s, const float r, const float x0, const float y0) {
+
+    float x = x0 + r * glm::sin(t) * glm::cos(s);
+    float y = y0 + r * glm::sin(t) * glm::sin(s);
+    float z = r * glm::cos(t);
+
+    return {x, y, z};
+}
+
+// The demo scene shown by the engine, shared with the benchmarks so they measure what the app draws. `time` in
+// seconds moves the surface and the sine waves and makes the spheres breathe; 0 is the still scene.
+inline void BuildDemoScene(GR::Grapher& grapher, const int width, const int height, const float time = 0.f)
+{
+    {
+        GR::Grapher::SurfaceInfo info;
+        info.batch = std::bind(SineSurfaceRow, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, 5.f, 0.1f, time * 2.f);
+        info.colorlo = 0xffff7f00;
+        info.colorhi = 0xfffe900;
+
+        grapher.AddSurface(info);
+    }
+
+    {
+        GR::Grapher::FunctionInfo info;
+
+        info.color = 0xfffd0000;
+
+        for (int i = 0; i < 25; ++i) {
+            info.function = std::bind(Linear, std::placeholders::_1, 0.f, static_cast<float>(height) - static_cast<float>(i) * (static_cast<float>(i) * 0.07f) * 3.f);
+            grapher.AddFunction(info);
+        }
+    }
+
+    {
+        GR::Grapher::FunctionInfo info;
+
+        info.color = 0xffffd644;
+        info.axis = GR::Axis::Y;
+        info.plot = GR::PlotType::LINE;
+
+        for (int i = 0; i < 7; ++i) {
+            info.function = std::bind(Sine, std::placeholders::_1, 10.f, 0.1f, static_cast<float>(i) * 1.f + time * 4.f, 15.f + static_cast<float>(i) * 30.f);
+
+            grapher.AddFunction(info);
+        }
+    }
+
+    {
+        GR::Grapher::EquationInfo info;
+        info.plot = GR::PlotType::LINE;
+        info.color = 0xff23d6ff;
+
+        for (int i = 0; i < 10; ++i) {
+            info.equation = std::bind(Circle, std::placeholders::_1, static_cast<float>(width) * 0.2f + 100.f * static_cast<float>(i), static_cast<float>(height) * 0.75 - 15.f * static_cast<float>(i), 40.f);
+            info.t0 = 0.f;
+            info.tMax = TWOPI + 0.5f * PI;
+            info.tStep = TWOPI / (3.f + static_cast<float>(i));
+
+            grapher.AddEquation(info);
+        }
+
+        info.color = 0xff88ff84;
+
+        info.t0 = 0.f;
+        info.tMax = TWOPI + 0.5f * PI;
+        info.tStep = TWOPI / 3.f;
+        for (int i = 0; i < 9; ++i) {
+            float angle = glm::radians(static_cast<float>(i) * 40.f);
+            info.equation = std::bind(Circle, std::placeholders::_1,
+                static_cast<float>(width) * 0.7f + static_cast<float>(i) * glm::cos(angle) * 35.f,
+                static_cast<float>(height) * 0.4f + static_cast<float>(i) * glm::sin(angle) * 35.f,
+                static_cast<float>(i + 1) * 10.f);
+            grapher.AddEquation(info);
+        }
+    }
+
+    {
+        GR::Grapher::ParametricSurfaceInfo info;
+
+
+        info.colorlo = 0xff000000;
+        info.colorhi = 0xffffffff;
+
+        info.t0 = 0.f;
+        info.tMax = TWOPI + 0.5f * PI;
+        info.tStep = TWOPI / 360.f;
+        info.s0 = 0.f;
+        info.sMax = TWOPI + 0.5f * PI;
+        info.sStep = TWOPI / 360.f;
+
+        const float breath = 1.f + 0.15f * glm::sin(time * PI);
+        for (int i = 0; i < 3; ++i) {
+            info.function = std::bind(Sphere, std::placeholders::_1, std::placeholders::_2, (120.f - static_cast<float>(i) * 20.f) * breath, static_cast<float>(width) * 0.15f + 150.f * static_cast<float>(i), static_cast<float>(height) * 0.15f+ 30.f * static_cast<float>(i));
+
+            grapher.AddParametricSurface(info);
+        }
+    }
+
+    {
+        GR::Grapher::ParametricSurfaceInfo info;
+
+        info.function = std::bind(Torus, std::placeholders::_1, std::placeholders::_2, 100.f, 20.f, static_cast<float>(width) * 0.75f, static_cast<float>(height) * 0.75f);
+        info.t0 = 0.f;
+        info.tMax = TWOPI + 0.5f * PI;
+        info.tStep = TWOPI / 360.f;
+        info.s0 = 0.f;
+        info.sMax = TWOPI + 0.5f * PI;
+        info.sStep = TWOPI / 720.f;
+
+        grapher.AddParametricSurface(info);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,639 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+#include "expression.hpp"
+#include "grapher.hpp"
+#include "scene.hpp"
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+// Times every Draw* path over a range of resolutions and sample densities and prints the results as JSON, so runs
+// can be diffed between versions. --scaling instead prints how DrawAll of the demo scene scales with workers, and
+// --allocations how many heap allocations a frame makes once the first frames have sized every buffer.
+
+// Every heap allocation of the process, counted for --allocations
+std::atomic<long long> heapAllocations = 0;
+
+// Every replaced operator new and delete below goes through these two, so whatever the overload, aligned or nothrow,
+// a block is counted once and freed the way it was allocated
+void* Allocate(size_t size, size_t alignment) noexcept
+{
+    ++heapAllocations;
+    alignment = std::max(alignment, alignof(std::max_align_t));
+    // aligned_alloc takes sizes that are a multiple of the alignment
+    size = (std::max<size_t>(size, 1) + alignment - 1) / alignment * alignment;
+#ifdef _MSC_VER
+    return _aligned_malloc(size, alignment);
+#else
+    return std::aligned_alloc(alignment, size);
+#endif
+}
+
+void Release(void* memory) noexcept
+{
+#ifdef _MSC_VER
+    _aligned_free(memory);
+#else
+    std::free(memory);
+#endif
+}
+
+void* AllocateOrThrow(const size_t size, const size_t alignment)
+{
+    if (void* memory = Allocate(size, alignment)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(const size_t size) { return AllocateOrThrow(size, 0); }
+void* operator new[](const size_t size) { return AllocateOrThrow(size, 0); }
+void* operator new(const size_t size, const std::align_val_t alignment) { return AllocateOrThrow(size, static_cast<size_t>(alignment)); }
+void* operator new[](const size_t size, const std::align_val_t alignment) { return AllocateOrThrow(size, static_cast<size_t>(alignment)); }
+void* operator new(const size_t size, const std::nothrow_t&) noexcept { return Allocate(size, 0); }
+void* operator new[](const size_t size, const std::nothrow_t&) noexcept { return Allocate(size, 0); }
+void* operator new(const size_t size, const std::align_val_t alignment, const std::nothrow_t&) noexcept { return Allocate(size, static_cast<size_t>(alignment)); }
+void* operator new[](const size_t size, const std::align_val_t alignment, const std::nothrow_t&) noexcept { return Allocate(size, static_cast<size_t>(alignment)); }
+
+void operator delete(void* memory) noexcept { Release(memory); }
+void operator delete[](void* memory) noexcept { Release(memory); }
+void operator delete(void* memory, size_t) noexcept { Release(memory); }
+void operator delete[](void* memory, size_t) noexcept { Release(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { Release(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { Release(memory); }
+void operator delete(void* memory, size_t, std::align_val_t) noexcept { Release(memory); }
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept { Release(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { Release(memory); }
+void operator delete[](void* memory, const std::nothrow_t&) noexcept { Release(memory); }
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept { Release(memory); }
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept { Release(memory); }
+
+struct Options {
+    std::vector<std::pair<int, int>> sizes = {{640, 360}, {1280, 720}, {1920, 1080}};
+    unsigned maxWorkers = std::max(1u, std::thread::hardware_concurrency());
+    int repeats = 5;
+    bool scaling = false;
+    bool allocations = false;
+    std::string output;
+};
+
+struct Result {
+    std::string name;
+    int width;
+    int height;
+    // Density knob of the case, 0 where the sample count follows from the resolution
+    int density;
+    unsigned workers;
+    long long samples;
+    double ms;
+};
+
+// Median of `repeats` runs; `setup` runs untimed before each one (clearing the framebuffer, invalidating layers)
+double Time(const std::function<void()>& setup, const std::function<void()>& run, const int repeats)
+{
+    std::vector<double> times;
+    for (int i = 0; i < repeats; ++i) {
+        setup();
+
+        const auto start = std::chrono::steady_clock::now();
+        run();
+        const auto end = std::chrono::steady_clock::now();
+
+        times.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+void Clear(std::vector<uint32_t>& pixels)
+{
+    GR::Clear(pixels.data(), pixels.size(), 0x28282828);
+}
+
+void RunSuite(const Options& options, std::vector<Result>& results)
+{
+    for (const auto& [width, height] : options.sizes) {
+        std::vector<uint32_t> pixels(static_cast<size_t>(width) * height);
+        const auto clear = [&] { Clear(pixels); };
+
+        // One layer per Draw* path, drawn through the static functions so nothing else is measured
+        for (const GR::PlotType plot : {GR::PlotType::PIXEL, GR::PlotType::LINE}) {
+            for (const GR::Axis axis : {GR::Axis::X, GR::Axis::Y}) {
+                GR::Grapher::FunctionInfo info;
+                info.plot = plot;
+                info.axis = axis;
+                const float extent = static_cast<float>(axis == GR::Axis::X ? height : width);
+                info.function = std::bind(Sine, std::placeholders::_1, extent * 0.4f, 0.05f, 0.f, extent * 0.5f);
+
+                const double ms = Time(clear, [&] { GR::Grapher::DrawFunction({pixels.data(), width, height}, info); }, options.repeats);
+                const std::string name = std::string("function_") + (plot == GR::PlotType::PIXEL ? "pixel" : "line") + (axis == GR::Axis::X ? "_x" : "_y");
+                results.push_back({name, width, height, 0, 1, axis == GR::Axis::X ? width : height, ms});
+            }
+        }
+
+        // The line and surface above composited with translucent colours instead of replacing the frame
+        for (const GR::BlendMode blend : {GR::BlendMode::OVER, GR::BlendMode::ADD}) {
+            const std::string suffix = blend == GR::BlendMode::OVER ? "_over" : "_add";
+
+            GR::Grapher::FunctionInfo line;
+            line.plot = GR::PlotType::LINE;
+            line.color = 0x80ffffff;
+            line.blend = blend;
+            line.function = std::bind(Sine, std::placeholders::_1, height * 0.4f, 0.05f, 0.f, height * 0.5f);
+            const double lineMs = Time(clear, [&] { GR::Grapher::DrawFunction({pixels.data(), width, height}, line); }, options.repeats);
+            results.push_back({"function_line_x" + suffix, width, height, 0, 1, width, lineMs});
+
+            GR::Grapher::SurfaceInfo surface;
+            surface.function = std::bind(SineSurface, std::placeholders::_1, std::placeholders::_2, 5.f, 0.1f, 0.f);
+            surface.colorlo = 0x400000ff;
+            surface.colorhi = 0xc0ff0000;
+            surface.blend = blend;
+            const double surfaceMs = Time(clear, [&] { GR::Grapher::DrawSurface({pixels.data(), width, height}, surface); }, options.repeats);
+            results.push_back({"surface" + suffix, width, height, 0, 1, static_cast<long long>(width) * height, surfaceMs});
+        }
+
+        {
+            GR::Grapher::SurfaceInfo info;
+            info.function = std::bind(SineSurface, std::placeholders::_1, std::placeholders::_2, 5.f, 0.1f, 0.f);
+            const double ms = Time(clear, [&] { GR::Grapher::DrawSurface({pixels.data(), width, height}, info); }, options.repeats);
+            results.push_back({"surface", width, height, 0, 1, static_cast<long long>(width) * height, ms});
+
+            // Eight iso-lines of a wider version of the surface instead of its shading, sampled every `density` pixels
+            for (const int density : {1, 4}) {
+                GR::Grapher::SurfaceInfo contours;
+                contours.function = std::bind(SineSurface, std::placeholders::_1, std::placeholders::_2, 5.f, 0.01f, 0.f);
+                contours.contours = {-4.f, -3.f, -2.f, -1.f, 1.f, 2.f, 3.f, 4.f};
+                contours.contourSpacing = density;
+                const double contourMs = Time(clear, [&] { GR::Grapher::DrawSurface({pixels.data(), width, height}, contours); }, options.repeats);
+                const long long samples = static_cast<long long>((width + density - 2) / density + 1) * ((height + density - 2) / density + 1);
+                results.push_back({"surface_contours", width, height, density, 1, samples, contourMs});
+            }
+
+            info.function = nullptr;
+            info.batch = std::bind(SineSurfaceRow, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, 5.f, 0.1f, 0.f);
+            const double batchMs = Time(clear, [&] { GR::Grapher::DrawSurface({pixels.data(), width, height}, info); }, options.repeats);
+            results.push_back({"surface_batch", width, height, 0, 1, static_cast<long long>(width) * height, batchMs});
+
+            // The same surface compiled from text
+            GR::Expression expression("a*sin(b*(x+y)+c)", {"x", "y"});
+            expression.SetParameter("a", 5.f);
+            expression.SetParameter("b", 0.1f);
+            info.batch = expression.Surface();
+            const double expressionMs = Time(clear, [&] { GR::Grapher::DrawSurface({pixels.data(), width, height}, info); }, options.repeats);
+            results.push_back({"surface_expression", width, height, 0, 1, static_cast<long long>(width) * height, expressionMs});
+
+            // The same surface in world space, redrawn after an 8 pixel pan against after a full re-evaluation
+            GR::Grapher grapher;
+            GR::Grapher::SurfaceInfo world;
+            world.world = expression.WorldSurface();
+            const size_t layer = grapher.AddSurface(world);
+            Clear(pixels);
+            grapher.DrawAll(pixels.data(), width, height);
+
+            const double fullMs = Time([&] { clear(); grapher.Invalidate(layer); }, [&] { grapher.DrawAll(pixels.data(), width, height); }, options.repeats);
+            results.push_back({"surface_world_full", width, height, 0, 1, static_cast<long long>(width) * height, fullMs});
+            const double panMs = Time(clear, [&] { grapher.Pan(8.0, 0.0); grapher.DrawAll(pixels.data(), width, height); }, options.repeats);
+            results.push_back({"surface_world_pan", width, height, 0, 1, 8LL * height, panMs});
+
+            // A colour change, which the evaluation cache draws from the kept samples
+            grapher.SetEvaluationCache(64u << 20);
+            Clear(pixels);
+            grapher.DrawAll(pixels.data(), width, height);
+            bool warm = false;
+            const auto restyle = [&] {
+                clear();
+                world.colorhi = (warm = !warm) ? 0xffff8000 : 0xffffffff;
+                grapher.UpdateSurfaceStyle(layer, world);
+            };
+            const double restyleMs = Time(restyle, [&] { grapher.DrawAll(pixels.data(), width, height); }, options.repeats);
+            results.push_back({"surface_world_restyle", width, height, 0, 1, 0, restyleMs});
+        }
+
+        // Samples per revolution of a circle filling most of the frame
+        for (const int density : {360, 3600, 36000}) {
+            for (const GR::PlotType plot : {GR::PlotType::PIXEL, GR::PlotType::LINE}) {
+                GR::Grapher::EquationInfo info;
+                info.plot = plot;
+                info.equation = std::bind(Circle, std::placeholders::_1, width * 0.5f, height * 0.5f, height * 0.45f);
+                info.t0 = 0.f;
+                info.tMax = TWOPI;
+                info.tStep = TWOPI / static_cast<float>(density);
+
+                const double ms = Time(clear, [&] { GR::Grapher::DrawEquation({pixels.data(), width, height}, info); }, options.repeats);
+                results.push_back({plot == GR::PlotType::PIXEL ? "equation_pixel" : "equation_line", width, height, density, 1, density, ms});
+
+                if (plot == GR::PlotType::LINE) {
+                    info.antialias = true;
+                    const double aaMs = Time(clear, [&] { GR::Grapher::DrawEquation({pixels.data(), width, height}, info); }, options.repeats);
+                    results.push_back({"equation_line_aa", width, height, density, 1, density, aaMs});
+                }
+            }
+        }
+
+        // Adaptive sampling, counting the evaluations it settles on
+        {
+            long long evaluations = 0;
+
+            GR::Grapher::FunctionInfo function;
+            function.plot = GR::PlotType::LINE;
+            function.sampling = GR::Sampling::ADAPTIVE;
+            function.function = [&](const int x) {
+                ++evaluations;
+                return Sine(x, height * 0.4f, 0.05f, 0.f, height * 0.5f);
+            };
+            const double functionMs = Time([&] { clear(); evaluations = 0; }, [&] { GR::Grapher::DrawFunction({pixels.data(), width, height}, function); }, options.repeats);
+            results.push_back({"function_line_adaptive", width, height, 0, 1, evaluations, functionMs});
+
+            GR::Grapher::EquationInfo equation;
+            equation.plot = GR::PlotType::LINE;
+            equation.sampling = GR::Sampling::ADAPTIVE;
+            equation.equation = [&](const float t) {
+                ++evaluations;
+                return Circle(t, width * 0.5f, height * 0.5f, height * 0.45f);
+            };
+            equation.t0 = 0.f;
+            equation.tMax = TWOPI;
+            const double equationMs = Time([&] { clear(); evaluations = 0; }, [&] { GR::Grapher::DrawEquation({pixels.data(), width, height}, equation); }, options.repeats);
+            results.push_back({"equation_line_adaptive", width, height, 0, 1, evaluations, equationMs});
+        }
+
+        // A circle as the zero set of x^2 + y^2 - r^2, pruned by sign sampling and by the expression's interval bounds,
+        // against shading the same expression at every pixel
+        {
+            long long evaluations = 0;
+            GR::Expression expression("(x-a)^2+(y-b)^2-r^2", {"x", "y"});
+            expression.SetParameter("a", width * 0.5f);
+            expression.SetParameter("b", height * 0.5f);
+            expression.SetParameter("r", height * 0.45f);
+            const auto field = expression.WorldSurface();
+
+            GR::Grapher::ImplicitInfo info;
+            info.function = [&](const float y, const std::span<const float> x, const std::span<float> out) {
+                evaluations += static_cast<long long>(out.size());
+                field(y, x, out);
+            };
+            const double sampledMs = Time([&] { clear(); evaluations = 0; }, [&] { GR::Grapher::DrawImplicit({pixels.data(), width, height}, info); }, options.repeats);
+            results.push_back({"implicit_sampled", width, height, 0, 1, evaluations, sampledMs});
+
+            info.bounds = expression.SurfaceBounds();
+            const double boundsMs = Time([&] { clear(); evaluations = 0; }, [&] { GR::Grapher::DrawImplicit({pixels.data(), width, height}, info); }, options.repeats);
+            results.push_back({"implicit_bounds", width, height, 0, 1, evaluations, boundsMs});
+
+            GR::Grapher::SurfaceInfo surface;
+            surface.batch = expression.Surface();
+            const double surfaceMs = Time(clear, [&] { GR::Grapher::DrawSurface({pixels.data(), width, height}, surface); }, options.repeats);
+            results.push_back({"implicit_as_surface", width, height, 0, 1, static_cast<long long>(width) * height, surfaceMs});
+        }
+
+        // Samples along each parameter of a sphere filling most of the frame
+        for (const int density : {180, 360, 720}) {
+            GR::Grapher::ParametricSurfaceInfo info;
+            info.function = std::bind(Sphere, std::placeholders::_1, std::placeholders::_2, height * 0.45f, width * 0.5f, height * 0.5f);
+            info.t0 = 0.f;
+            info.tMax = PI;
+            info.tStep = PI / static_cast<float>(density);
+            info.s0 = 0.f;
+            info.sMax = TWOPI;
+            info.sStep = TWOPI / static_cast<float>(density);
+
+            const double ms = Time(clear, [&] { GR::Grapher::DrawParametricSurface({pixels.data(), width, height}, info); }, options.repeats);
+            results.push_back({"parametric_surface", width, height, density, 1, static_cast<long long>(density) * density, ms});
+        }
+
+        // The same sphere as a triangle mesh, which covers it without holes from far fewer samples
+        for (const int density : {32, 64, 128}) {
+            GR::Grapher::ParametricSurfaceInfo info;
+            info.function = std::bind(Sphere, std::placeholders::_1, std::placeholders::_2, height * 0.45f, width * 0.5f, height * 0.5f);
+            info.t0 = 0.f;
+            info.tMax = PI;
+            info.tStep = PI / static_cast<float>(density);
+            info.s0 = 0.f;
+            info.sMax = TWOPI;
+            info.sStep = TWOPI / static_cast<float>(density);
+            info.mesh = true;
+
+            const double ms = Time(clear, [&] { GR::Grapher::DrawParametricSurface({pixels.data(), width, height}, info); }, options.repeats);
+            results.push_back({"parametric_mesh", width, height, density, 1, static_cast<long long>(density + 1) * (density + 1), ms});
+
+            info.cull = true;
+            const double culledMs = Time(clear, [&] { GR::Grapher::DrawParametricSurface({pixels.data(), width, height}, info); }, options.repeats);
+            results.push_back({"parametric_mesh_culled", width, height, density, 1, static_cast<long long>(density + 1) * (density + 1), culledMs});
+        }
+
+        // A random walk of `density` samples fitted to the frame, reduced per column through the summary
+        for (const int density : {1000000, 10000000}) {
+            std::vector<float> walk(density);
+            float value = 0.f;
+            for (int i = 0; i < density; ++i) {
+                value += std::sin(static_cast<float>(i) * 0.37f) + std::sin(static_cast<float>(i) * 0.0011f) * 0.05f;
+                walk[i] = value;
+            }
+            const auto [lo, hi] = std::minmax_element(walk.begin(), walk.end());
+
+            GR::Series series;
+            series.Assign(walk);
+            GR::Grapher::SeriesInfo info;
+            info.series = &series;
+            info.dx = static_cast<double>(width) / density;
+            info.dy = height / std::max(1e-6f, *hi - *lo);
+            info.y0 = -*lo * info.dy;
+            const GR::Grapher::Viewport viewport = {0.0, static_cast<double>(height), 1.0};
+
+            const double ms = Time(clear, [&] { GR::Grapher::DrawSeries({pixels.data(), width, height}, info, viewport); }, options.repeats);
+            results.push_back({"series_m4", width, height, density, 1, density, ms});
+        }
+
+        // A strip chart of 16 samples per column that scrolls by one column per frame
+        {
+            GR::Stream stream(static_cast<size_t>(width) * 16);
+            GR::Grapher grapher;
+            GR::Grapher::StreamInfo info;
+            info.stream = &stream;
+            info.samplesPerColumn = 16;
+            info.dy = -height * 0.4;
+            grapher.AddStream(info);
+            grapher.SetViewport({0.0, height * 0.5, 1.0});
+
+            uint64_t appended = 0;
+            auto append = [&](const int count) {
+                for (int i = 0; i < count; ++i, ++appended) {
+                    stream.Append(std::sin(static_cast<float>(appended) * 0.01f));
+                }
+            };
+            append(width * 16);
+            Clear(pixels);
+            grapher.DrawAll(pixels.data(), width, height);
+
+            const double ms = Time([&] { clear(); append(16); }, [&] { grapher.DrawAll(pixels.data(), width, height); }, options.repeats);
+            results.push_back({"stream_scroll", width, height, 16, 1, 16, ms});
+        }
+
+        // The whole demo scene, serial against every optimization DrawAll has
+        for (const unsigned workers : {1u, options.maxWorkers}) {
+            GR::Grapher grapher;
+            BuildDemoScene(grapher, width, height);
+            grapher.SetWorkerCount(workers);
+
+            const double ms = Time(clear, [&] { grapher.DrawAll(pixels.data(), width, height); }, options.repeats);
+            results.push_back({"drawall_demo", width, height, 0, workers, 0, ms});
+
+            // Time to the first, coarsest progressive frame after the surface changed
+            const double progressiveMs = Time([&] { clear(); grapher.Invalidate(0); }, [&] { grapher.DrawProgressive(pixels.data(), width, height, 0.0); }, options.repeats);
+            results.push_back({"drawprogressive_demo_first_frame", width, height, 0, workers, 0, progressiveMs});
+
+            // A redraw after one sine layer changed
+            grapher.SetLayerCache(true);
+            Clear(pixels);
+            grapher.DrawAll(pixels.data(), width, height);
+            const double cachedMs = Time([&] { clear(); grapher.Invalidate(27); }, [&] { grapher.DrawAll(pixels.data(), width, height); }, options.repeats);
+            results.push_back({"drawall_demo_one_dirty_layer", width, height, 0, workers, 0, cachedMs});
+
+            // The same redraw through DrawProgressive, as the app makes it
+            while (!grapher.DrawProgressive(pixels.data(), width, height, 0.0)) {
+            }
+            const double cachedProgressiveMs = Time([&] { clear(); grapher.Invalidate(27); },
+                                                    [&] { grapher.DrawProgressive(pixels.data(), width, height, 0.0); }, options.repeats);
+            results.push_back({"drawprogressive_demo_one_dirty_layer", width, height, 0, workers, 0, cachedProgressiveMs});
+
+            if (options.maxWorkers == 1) {
+                break;
+            }
+        }
+
+        // The demo scene anti-aliased by supersampling, density being the factor, against drawall_demo
+        for (const int factor : {2, 4}) {
+            for (const GR::Filter filter : {GR::Filter::BOX, GR::Filter::TENT}) {
+                GR::Grapher grapher;
+                BuildDemoScene(grapher, width, height);
+                grapher.SetSupersampling(factor, filter);
+
+                const double ms = Time(clear, [&] { grapher.DrawAll(pixels.data(), width, height); }, options.repeats);
+                results.push_back({filter == GR::Filter::BOX ? "drawall_demo_ssaa_box" : "drawall_demo_ssaa_tent", width, height, factor, 1, 0, ms});
+            }
+        }
+    }
+}
+
+void PrintJson(std::ostream& out, const std::vector<Result>& results)
+{
+    out << "{\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& result = results[i];
+        const double pixels = static_cast<double>(result.width) * result.height;
+        const double samplesPerSec = result.samples > 0 ? static_cast<double>(result.samples) / (result.ms / 1000.0) : 0.0;
+
+        char line[512];
+        snprintf(line, sizeof(line),
+                 "    {\"name\": \"%s\", \"width\": %d, \"height\": %d, \"density\": %d, \"workers\": %u, \"samples\": %lld, "
+                 "\"ms\": %.4f, \"ns_per_pixel\": %.4f, \"samples_per_sec\": %.1f}%s\n",
+                 result.name.c_str(), result.width, result.height, result.density, result.workers, result.samples,
+                 result.ms, result.ms * 1e6 / pixels, samplesPerSec, i + 1 < results.size() ? "," : "");
+        out << line;
+    }
+    out << "  ]\n}\n";
+}
+
+void RunScaling(const Options& options)
+{
+    constexpr int width = 1280;
+    constexpr int height = 720;
+
+    GR::Grapher grapher;
+    BuildDemoScene(grapher, width, height);
+
+    std::vector<uint32_t> reference(width * height);
+    std::vector<uint32_t> pixels(width * height);
+
+    grapher.SetWorkerCount(1);
+    const double serial = Time([&] { Clear(reference); }, [&] { grapher.DrawAll(reference.data(), width, height); }, options.repeats);
+
+    std::cout << "workers  ms/frame  speedup  efficiency  identical" << std::endl;
+
+    for (unsigned workers = 1; workers <= options.maxWorkers; ++workers) {
+        grapher.SetWorkerCount(workers);
+        const double ms = workers == 1 ? serial : Time([&] { Clear(pixels); }, [&] { grapher.DrawAll(pixels.data(), width, height); }, options.repeats);
+        const bool identical = workers == 1 || pixels == reference;
+
+        const double speedup = serial / ms;
+        printf("%7u  %8.2f  %7.2f  %9.0f%%  %s\n", workers, ms, speedup, 100.0 * speedup / workers, identical ? "yes" : "NO");
+    }
+}
+
+// Allocations per frame of every draw path after two warm-up frames, false when any of them allocates
+bool RunAllocations(const Options& options)
+{
+    constexpr int width = 1280;
+    constexpr int height = 720;
+    constexpr int frames = 16;
+
+    std::vector<uint32_t> pixels(width * height);
+    bool none = true;
+
+    std::cout << "case                     workers  allocations/frame" << std::endl;
+    auto measure = [&](const char* name, const unsigned workers, const std::function<void()>& frame) {
+        frame();
+        frame();
+        const long long before = heapAllocations;
+        for (int i = 0; i < frames; ++i) {
+            frame();
+        }
+        const double perFrame = static_cast<double>(heapAllocations - before) / frames;
+        none = none && perFrame == 0.0;
+        printf("%-24s %8u  %17.2f\n", name, workers, perFrame);
+    };
+
+    for (const unsigned workers : {1u, options.maxWorkers}) {
+        GR::Grapher grapher;
+        BuildDemoScene(grapher, width, height);
+        grapher.SetWorkerCount(workers);
+
+        measure("drawall_demo", workers, [&] { Clear(pixels); grapher.DrawAll(pixels.data(), width, height); });
+        measure("drawprogressive_demo", workers, [&] {
+            grapher.Invalidate(0);
+            while (!grapher.DrawProgressive(pixels.data(), width, height, 0.0)) {
+            }
+        });
+        grapher.SetLayerCache(true);
+        measure("drawall_demo_one_dirty", workers, [&] { Clear(pixels); grapher.Invalidate(27); grapher.DrawAll(pixels.data(), width, height); });
+        measure("progressive_one_dirty", workers, [&] {
+            grapher.Invalidate(27);
+            while (!grapher.DrawProgressive(pixels.data(), width, height, 0.0)) {
+            }
+        });
+        grapher.SetSupersampling(2, GR::Filter::TENT);
+        measure("drawall_demo_ssaa", workers, [&] { Clear(pixels); grapher.Invalidate(27); grapher.DrawAll(pixels.data(), width, height); });
+
+        // World-space layers re-evaluated on every pan
+        GR::Grapher world;
+        world.SetWorkerCount(workers);
+        GR::Expression expression("sin(x*0.05)*cos(y*0.05)", {"x", "y"});
+        GR::Grapher::SurfaceInfo surface;
+        surface.world = expression.WorldSurface();
+        world.AddSurface(surface);
+        GR::Grapher::EquationInfo circle;
+        circle.plot = GR::PlotType::LINE;
+        circle.sampling = GR::Sampling::ADAPTIVE;
+        circle.world = true;
+        circle.equation = std::bind(Circle, std::placeholders::_1, 0.f, 0.f, height * 0.45f);
+        circle.t0 = 0.f;
+        circle.tMax = TWOPI;
+        world.AddEquation(circle);
+        measure("drawall_world_pan", workers, [&] { world.Pan(8.0, 0.0); world.DrawAll(pixels.data(), width, height); });
+        // Every new view keeps the last one in the evaluation cache, which holds a single view of the surface, so
+        // each one evicts the one before and reuses its storage
+        GR::Grapher cached;
+        cached.SetWorkerCount(workers);
+        cached.AddSurface(surface);
+        cached.SetEvaluationCache(static_cast<size_t>(width) * height * sizeof(float));
+        measure("drawall_world_pan_cached", workers, [&] { cached.Pan(8.0, 0.0); cached.DrawAll(pixels.data(), width, height); });
+
+        if (options.maxWorkers == 1) {
+            break;
+        }
+    }
+
+    // The static Draw functions keep their scratch per thread
+    GR::Grapher::FunctionInfo function;
+    function.plot = GR::PlotType::LINE;
+    function.sampling = GR::Sampling::ADAPTIVE;
+    function.function = std::bind(Sine, std::placeholders::_1, height * 0.4f, 0.05f, 0.f, height * 0.5f);
+    GR::Grapher::ParametricSurfaceInfo sphere;
+    sphere.function = std::bind(Sphere, std::placeholders::_1, std::placeholders::_2, height * 0.45f, width * 0.5f, height * 0.5f);
+    sphere.t0 = 0.f;
+    sphere.tMax = PI;
+    sphere.tStep = PI / 360.f;
+    sphere.s0 = 0.f;
+    sphere.sMax = TWOPI;
+    sphere.sStep = TWOPI / 360.f;
+    measure("static_draws", 1, [&] {
+        GR::Grapher::DrawFunction({pixels.data(), width, height}, function);
+        GR::Grapher::DrawParametricSurface({pixels.data(), width, height}, sphere);
+    });
+    measure("static_draws_ssaa", 1, [&] {
+        GR::Grapher::Supersample({pixels.data(), width, height}, 2, GR::Filter::BOX, [&](const auto& frame) {
+            GR::Grapher::DrawFunction(frame, function);
+            GR::Grapher::DrawParametricSurface(frame, sphere);
+        });
+    });
+
+    return none;
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--scaling") {
+            options.scaling = true;
+        }
+        else if (arg == "--allocations") {
+            options.allocations = true;
+        }
+        else if (arg == "--workers" && hasValue) {
+            options.maxWorkers = std::max(1, std::stoi(argv[++i]));
+        }
+        else if (arg == "--repeats" && hasValue) {
+            options.repeats = std::max(1, std::stoi(argv[++i]));
+        }
+        else if (arg == "--output" && hasValue) {
+            options.output = argv[++i];
+        }
+        else if (arg == "--sizes" && hasValue) {
+            // Comma separated WIDTHxHEIGHT list
+            options.sizes.clear();
+            const std::string list = argv[++i];
+            for (size_t start = 0; start < list.size();) {
+                const size_t end = std::min(list.find(',', start), list.size());
+                int width = 0;
+                int height = 0;
+                if (sscanf(list.substr(start, end - start).c_str(), "%dx%d", &width, &height) == 2 && width > 0 && height > 0) {
+                    options.sizes.emplace_back(width, height);
+                }
+                start = end + 1;
+            }
+        }
+        else {
+            std::cerr << "Usage: bench [--scaling | --allocations] [--workers N] [--repeats N] [--sizes WxH,...] [--output FILE]" << std::endl;
+            return 1;
+        }
+    }
+
+    if (options.scaling) {
+        RunScaling(options);
+        return 0;
+    }
+    if (options.allocations) {
+        return RunAllocations(options) ? 0 : 1;
+    }
+
+    std::vector<Result> results;
+    RunSuite(options, results);
+
+    if (options.output.empty()) {
+        PrintJson(std::cout, results);
+    }
+    else {
+        std::ofstream file(options.output);
+        PrintJson(file, results);
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "grapher.hpp"
+
+namespace GR
+{
+    // A parameter sweep over frames: every frame builds its scene from the frame's time, so any layer parameter can
+    // be a function of time
+    struct Animation {
+        int width = 0;
+        int height = 0;
+        int frames = 0;
+        int fps = 30;
+        // Adds the layers of the frame at `time` seconds to an empty Grapher
+        std::function<void(Grapher& grapher, int width, int height, float time)> scene;
+        // Every frame starts out as this color
+        uint32_t background = 0xff000000;
+    };
+
+    // Receives the finished frames strictly in order; returning false stops the render
+    using FrameSink = std::function<bool(const uint32_t* pixels, int frame)>;
+
+    // Renders whole frames in parallel, one per worker with its own Grapher, and hands them to sink in order from the
+    // calling thread. At most `queue` frames are in flight, rendering or waiting for their turn, which bounds the
+    // memory to `queue` framebuffers however far a fast worker gets ahead of a slow frame. False when the sink failed.
+    inline bool RenderAnimation(const Animation& animation, unsigned workers, int queue, const FrameSink& sink)
+    {
+        workers = workers == 0 ? std::max(1u, std::thread::hardware_concurrency()) : workers;
+        queue = std::max(queue, 1);
+        if (animation.frames <= 0 || animation.width <= 0 || animation.height <= 0) {
+            return true;
+        }
+
+        // Frame f renders into slot f % queue, which is free once frame f - queue has been written
+        std::vector<std::vector<uint32_t>> slots(queue);
+        std::vector<char> ready(queue, 0);
+        std::mutex mutex;
+        std::condition_variable changed;
+        int next = 0;
+        int written = 0;
+        bool failed = false;
+
+        auto work = [&] {
+            while (true) {
+                int frame;
+                {
+                    std::unique_lock lock(mutex);
+                    changed.wait(lock, [&] { return failed || next >= animation.frames || next < written + queue; });
+                    if (failed || next >= animation.frames) {
+                        return;
+                    }
+                    frame = next++;
+                }
+
+                std::vector<uint32_t>& pixels = slots[frame % queue];
+                pixels.assign(static_cast<size_t>(animation.width) * animation.height, animation.background);
+
+                Grapher grapher;
+                animation.scene(grapher, animation.width, animation.height, static_cast<float>(frame) / static_cast<float>(animation.fps));
+                grapher.DrawAll(pixels.data(), animation.width, animation.height);
+
+                {
+                    std::lock_guard lock(mutex);
+                    ready[frame % queue] = 1;
+                }
+                changed.notify_all();
+            }
+        };
+
+        std::vector<std::jthread> threads;
+        threads.reserve(workers);
+        for (unsigned i = 0; i < workers; ++i) {
+            threads.emplace_back(work);
+        }
+
+        for (int frame = 0; frame < animation.frames; ++frame) {
+            const int slot = frame % queue;
+            {
+                std::unique_lock lock(mutex);
+                changed.wait(lock, [&] { return ready[slot] != 0; });
+            }
+            const bool ok = sink(slots[slot].data(), frame);
+            {
+                std::lock_guard lock(mutex);
+                ready[slot] = 0;
+                written = frame + 1;
+                failed = !ok;
+            }
+            changed.notify_all();
+            if (!ok) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
\ No newline at end of file
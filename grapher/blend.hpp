@@ -0,0 +1,279 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include "defines.hpp"
+
+#if GRAPHER_SSE2
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+namespace GR
+{
+    // How a layer's pixels combine with the framebuffer below them. Colours are 0xAARRGGBB with straight alpha.
+    enum class BlendMode : uint8_t {
+        // Overwrites the pixel, alpha included
+        REPLACE,
+        // Mixes the colour over the pixel by the colour's alpha, the result is as opaque as the colour makes it
+        OVER,
+        // Adds the colour weighted by its alpha, clamping every channel at 255
+        ADD,
+        // Keeps the larger value of every channel, alpha included
+        MAX
+    };
+
+    // Mixes src over dst by coverage (0-255), two 8-bit channels per multiply
+    inline uint32_t Mix(const uint32_t dst, const uint32_t src, const uint32_t coverage)
+    {
+        const uint32_t a = coverage + (coverage >> 7);
+        const uint32_t rb = ((src & 0x00ff00ff) * a + (dst & 0x00ff00ff) * (256 - a)) >> 8 & 0x00ff00ff;
+        const uint32_t ag = ((src >> 8 & 0x00ff00ff) * a + (dst >> 8 & 0x00ff00ff) * (256 - a)) & 0xff00ff00;
+        return rb | ag;
+    }
+
+    // Adds two pixels channel by channel, clamping every channel at 255
+    inline uint32_t AddSaturate(const uint32_t a, const uint32_t b)
+    {
+        const uint32_t rb = (a & 0x00ff00ff) + (b & 0x00ff00ff);
+        const uint32_t ag = (a >> 8 & 0x00ff00ff) + (b >> 8 & 0x00ff00ff);
+        // A carry out of a channel sets all of its bits
+        return ((rb | (rb >> 8 & 0x00010001) * 0xff) & 0x00ff00ff) | ((ag | (ag >> 8 & 0x00010001) * 0xff) & 0x00ff00ff) << 8;
+    }
+
+    inline uint32_t MaxChannels(const uint32_t a, const uint32_t b)
+    {
+        uint32_t out = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            out |= std::max(a >> shift & 0xff, b >> shift & 0xff) << shift;
+        }
+        return out;
+    }
+
+    // One pixel of src combined with dst by mode. Coverage (0-255) scales what src contributes, as anti-aliased
+    // lines need; at 255 every mode matches its span and row kernels exactly.
+    inline uint32_t Compose(const BlendMode mode, const uint32_t dst, const uint32_t src, const uint32_t coverage = 255)
+    {
+        const uint32_t weight = ((src >> 24) * coverage + 127) / 255;
+        switch (mode) {
+            case BlendMode::REPLACE:
+                return coverage == 255 ? src : Mix(dst, src, coverage);
+            case BlendMode::OVER:
+                return Mix(dst, src | 0xff000000, weight);
+            case BlendMode::ADD:
+                return AddSaturate(dst, Mix(0, src | 0xff000000, weight));
+            case BlendMode::MAX:
+                return Mix(dst, MaxChannels(dst, src), coverage);
+        }
+        return src;
+    }
+
+    namespace Detail
+    {
+        inline void FillSpanScalar(uint32_t* pixels, const size_t count, const uint32_t color, const BlendMode mode)
+        {
+            if (mode == BlendMode::REPLACE) {
+                std::fill_n(pixels, count, color);
+                return;
+            }
+            for (size_t i = 0; i < count; ++i) {
+                pixels[i] = Compose(mode, pixels[i], color);
+            }
+        }
+
+        inline void BlendRowScalar(uint32_t* dst, const uint32_t* src, const size_t count, const BlendMode mode)
+        {
+            if (mode == BlendMode::REPLACE) {
+                std::memcpy(dst, src, count * sizeof(uint32_t));
+                return;
+            }
+            for (size_t i = 0; i < count; ++i) {
+                dst[i] = Compose(mode, dst[i], src[i]);
+            }
+        }
+
+#if GRAPHER_SSE2
+        // The kernels widen every channel to 16 bits, where (src * a + dst * (256 - a)) >> 8 is exactly what Mix
+        // computes two channels at a time
+
+        // Alpha of each of the two pixels in s16 spread over its four channels and scaled to 0-256 like Mix
+        inline __m128i Alpha16(const __m128i s16)
+        {
+            const __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s16, 0xff), 0xff);
+            return _mm_add_epi16(a, _mm_srli_epi16(a, 7));
+        }
+
+        inline __m128i Mix16(const __m128i d16, const __m128i s16, const __m128i a16)
+        {
+            const __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(256), a16);
+            return _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(s16, a16), _mm_mullo_epi16(d16, inverse)), 8);
+        }
+
+        inline __m128i Compose4(const BlendMode mode, const __m128i d, const __m128i s)
+        {
+            if (mode == BlendMode::REPLACE) {
+                return s;
+            }
+            if (mode == BlendMode::MAX) {
+                return _mm_max_epu8(d, s);
+            }
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i opaque = _mm_or_si128(s, _mm_set1_epi32(static_cast<int>(0xff000000)));
+            const __m128i aLo = Alpha16(_mm_unpacklo_epi8(s, zero));
+            const __m128i aHi = Alpha16(_mm_unpackhi_epi8(s, zero));
+            const __m128i sLo = _mm_unpacklo_epi8(opaque, zero);
+            const __m128i sHi = _mm_unpackhi_epi8(opaque, zero);
+            if (mode == BlendMode::OVER) {
+                return _mm_packus_epi16(Mix16(_mm_unpacklo_epi8(d, zero), sLo, aLo), Mix16(_mm_unpackhi_epi8(d, zero), sHi, aHi));
+            }
+            const __m128i weighted = _mm_packus_epi16(_mm_srli_epi16(_mm_mullo_epi16(sLo, aLo), 8), _mm_srli_epi16(_mm_mullo_epi16(sHi, aHi), 8));
+            return _mm_adds_epu8(d, weighted);
+        }
+
+        inline void FillSpanSse2(uint32_t* pixels, const size_t count, const uint32_t color, const BlendMode mode)
+        {
+            const __m128i s = _mm_set1_epi32(static_cast<int>(color));
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4) {
+                __m128i* at = reinterpret_cast<__m128i*>(pixels + i);
+                _mm_storeu_si128(at, Compose4(mode, _mm_loadu_si128(at), s));
+            }
+            FillSpanScalar(pixels + i, count - i, color, mode);
+        }
+
+        inline void BlendRowSse2(uint32_t* dst, const uint32_t* src, const size_t count, const BlendMode mode)
+        {
+            if (mode == BlendMode::REPLACE) {
+                std::memcpy(dst, src, count * sizeof(uint32_t));
+                return;
+            }
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4) {
+                __m128i* at = reinterpret_cast<__m128i*>(dst + i);
+                _mm_storeu_si128(at, Compose4(mode, _mm_loadu_si128(at), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))));
+            }
+            BlendRowScalar(dst + i, src + i, count - i, mode);
+        }
+
+        GRAPHER_TARGET_AVX2 inline __m256i Alpha16x16(const __m256i s16)
+        {
+            const __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s16, 0xff), 0xff);
+            return _mm256_add_epi16(a, _mm256_srli_epi16(a, 7));
+        }
+
+        GRAPHER_TARGET_AVX2 inline __m256i Mix16x16(const __m256i d16, const __m256i s16, const __m256i a16)
+        {
+            const __m256i inverse = _mm256_sub_epi16(_mm256_set1_epi16(256), a16);
+            return _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(s16, a16), _mm256_mullo_epi16(d16, inverse)), 8);
+        }
+
+        // Unpacking and packing both work within 128-bit lanes, so the pixels come back in order
+        GRAPHER_TARGET_AVX2 inline __m256i Compose8(const BlendMode mode, const __m256i d, const __m256i s)
+        {
+            if (mode == BlendMode::REPLACE) {
+                return s;
+            }
+            if (mode == BlendMode::MAX) {
+                return _mm256_max_epu8(d, s);
+            }
+            const __m256i zero = _mm256_setzero_si256();
+            const __m256i opaque = _mm256_or_si256(s, _mm256_set1_epi32(static_cast<int>(0xff000000)));
+            const __m256i aLo = Alpha16x16(_mm256_unpacklo_epi8(s, zero));
+            const __m256i aHi = Alpha16x16(_mm256_unpackhi_epi8(s, zero));
+            const __m256i sLo = _mm256_unpacklo_epi8(opaque, zero);
+            const __m256i sHi = _mm256_unpackhi_epi8(opaque, zero);
+            if (mode == BlendMode::OVER) {
+                return _mm256_packus_epi16(Mix16x16(_mm256_unpacklo_epi8(d, zero), sLo, aLo), Mix16x16(_mm256_unpackhi_epi8(d, zero), sHi, aHi));
+            }
+            const __m256i weighted = _mm256_packus_epi16(_mm256_srli_epi16(_mm256_mullo_epi16(sLo, aLo), 8),
+                                                         _mm256_srli_epi16(_mm256_mullo_epi16(sHi, aHi), 8));
+            return _mm256_adds_epu8(d, weighted);
+        }
+
+        GRAPHER_TARGET_AVX2 inline void FillSpanAvx2(uint32_t* pixels, const size_t count, const uint32_t color, const BlendMode mode)
+        {
+            const __m256i s = _mm256_set1_epi32(static_cast<int>(color));
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                __m256i* at = reinterpret_cast<__m256i*>(pixels + i);
+                _mm256_storeu_si256(at, Compose8(mode, _mm256_loadu_si256(at), s));
+            }
+            FillSpanScalar(pixels + i, count - i, color, mode);
+        }
+
+        GRAPHER_TARGET_AVX2 inline void BlendRowAvx2(uint32_t* dst, const uint32_t* src, const size_t count, const BlendMode mode)
+        {
+            if (mode == BlendMode::REPLACE) {
+                std::memcpy(dst, src, count * sizeof(uint32_t));
+                return;
+            }
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                __m256i* at = reinterpret_cast<__m256i*>(dst + i);
+                _mm256_storeu_si256(at, Compose8(mode, _mm256_loadu_si256(at), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i))));
+            }
+            BlendRowScalar(dst + i, src + i, count - i, mode);
+        }
+#endif
+
+        // Whether the CPU and the operating system both support AVX2
+        inline bool HasAvx2()
+        {
+#if GRAPHER_SSE2 && defined(_MSC_VER)
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7) {
+                return false;
+            }
+            // AVX, OSXSAVE and the OS saving the YMM registers on context switches
+            __cpuid(info, 1);
+            if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6) {
+                return false;
+            }
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+#elif GRAPHER_SSE2
+            return __builtin_cpu_supports("avx2");
+#else
+            return false;
+#endif
+        }
+
+        struct PixelKernels {
+            void (*fill)(uint32_t* pixels, size_t count, uint32_t color, BlendMode mode);
+            void (*blend)(uint32_t* dst, const uint32_t* src, size_t count, BlendMode mode);
+        };
+
+        // Picked once, on first use, from what the CPU running the program supports
+        inline const PixelKernels& Kernels()
+        {
+#if GRAPHER_SSE2
+            static const PixelKernels kernels = HasAvx2() ? PixelKernels{FillSpanAvx2, BlendRowAvx2} : PixelKernels{FillSpanSse2, BlendRowSse2};
+#else
+            static const PixelKernels kernels = {FillSpanScalar, BlendRowScalar};
+#endif
+            return kernels;
+        }
+    }
+
+    // Combines count pixels with one colour, e.g. a horizontal run of a line
+    inline void FillSpan(uint32_t* pixels, const size_t count, const uint32_t color, const BlendMode mode = BlendMode::REPLACE)
+    {
+        Detail::Kernels().fill(pixels, count, color, mode);
+    }
+
+    // Combines a row of colours with the row below it, e.g. a colormapped surface row with the framebuffer
+    inline void BlendRow(uint32_t* dst, const uint32_t* src, const size_t count, const BlendMode mode = BlendMode::REPLACE)
+    {
+        Detail::Kernels().blend(dst, src, count, mode);
+    }
+
+    // Sets count pixels to color, which unlike a byte memset can be any colour
+    inline void Clear(uint32_t* pixels, const size_t count, const uint32_t color)
+    {
+        FillSpan(pixels, count, color);
+    }
+}
\ No newline at end of file
@@ -1 +1,15 @@
-#pragma once
\ No newline at end of file
+#pragma once
+
+// The SSE2 paths are picked at compile time from what the target architecture guarantees.
+// MSVC does not define __SSE2__, but SSE2 is part of the x64 baseline.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GRAPHER_SSE2 1
+#endif
+
+// Kernels picked at run time are compiled for AVX2 whatever the target architecture. MSVC accepts the intrinsics
+// anywhere, GCC and Clang only in functions marked for the instruction set.
+#if defined(__GNUC__) || defined(__clang__)
+#define GRAPHER_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define GRAPHER_TARGET_AVX2
+#endif
\ No newline at end of file
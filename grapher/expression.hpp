@@ -0,0 +1,716 @@
+#pragma once
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <initializer_list>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace GR
+{
+    // A plot function given as text, e.g. "a*sin(b*x+c)+d". Compile() parses it once into a stack program; every
+    // other identifier than the variables, the functions and the constants pi and e becomes a named parameter that
+    // starts at 0. Evaluation runs each instruction over a block of samples at a time, so the dispatch is paid once
+    // per block and the arithmetic is a plain loop the compiler can vectorize.
+    //
+    // Grammar: + - * / with the usual precedence, ^ for powers (right associative, binds tighter than unary minus),
+    // sin cos tan asin acos atan sinh cosh tanh sqrt abs exp log floor ceil and the two-argument min max pow atan2.
+    class Expression
+    {
+    public:
+        // Samples evaluated together by one pass over the program
+        static constexpr int BLOCK = 64;
+        // Deepest operand stack a program may need
+        static constexpr int MAX_STACK = 32;
+        // Samples a short block is rounded up to, the widest vector of floats
+        static constexpr int LANES = 8;
+
+        // Where a variable takes its values from: `values` when set, else start + step * i, which covers both the
+        // running x of a row and a y that stays the same along it
+        struct Input {
+            float start = 0.f;
+            float step = 0.f;
+            const float* values = nullptr;
+        };
+
+        // Every value from lo to hi
+        struct Interval {
+            float lo;
+            float hi;
+        };
+
+        Expression() = default;
+
+        Expression(const std::string_view source, const std::initializer_list<std::string_view> variables)
+        {
+            Compile(source, variables);
+        }
+
+        // False when source does not parse, with the reason in Error()
+        bool Compile(const std::string_view source, const std::initializer_list<std::string_view> variables)
+        {
+            _variables.assign(variables.begin(), variables.end());
+            _code.clear();
+            _parameterNames.clear();
+            _parameters.clear();
+            _error.clear();
+            _source = source;
+            _position = 0;
+            _depth = 0;
+            _maxDepth = 0;
+
+            ParseSum();
+            SkipSpace();
+            if (_error.empty() && _position < _source.size()) {
+                Fail("unexpected '" + std::string(1, _source[_position]) + "'");
+            }
+            if (!_error.empty()) {
+                _code.clear();
+                return false;
+            }
+            return true;
+        }
+
+        bool Valid() const {
+            return !_code.empty();
+        }
+
+        const std::string& Error() const {
+            return _error;
+        }
+
+        const std::vector<std::string>& Parameters() const {
+            return _parameterNames;
+        }
+
+        // False when the expression has no such parameter
+        bool SetParameter(const std::string_view name, const float value)
+        {
+            for (size_t i = 0; i < _parameterNames.size(); ++i) {
+                if (_parameterNames[i] == name) {
+                    _parameters[i] = value;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // out[i] for every i, variable v taking its values from inputs[v]
+        void Evaluate(const std::span<const Input> inputs, const std::span<float> out) const
+        {
+            if (_code.empty() || inputs.size() < _variables.size()) {
+                std::fill(out.begin(), out.end(), NAN);
+                return;
+            }
+
+            float stack[MAX_STACK][BLOCK];
+            const int count = static_cast<int>(out.size());
+
+            for (int base = 0; base < count; base += BLOCK) {
+                // Every pass runs over n rounded up to whole vectors, lanes past the end just carry unused values.
+                // Short calls, like the few samples of a cell of an implicit layer, do not pay for a whole block.
+                const int n = std::min(BLOCK, count - base);
+                const int lanes = std::min(BLOCK, (n + LANES - 1) / LANES * LANES);
+                int top = -1;
+
+                for (const Instruction& instruction : _code) {
+                    float* r = stack[top + 1];
+                    switch (instruction.op) {
+                        case Op::CONSTANT:
+                            std::fill(r, r + lanes, instruction.value);
+                            ++top;
+                            break;
+                        case Op::PARAMETER:
+                            std::fill(r, r + lanes, _parameters[instruction.index]);
+                            ++top;
+                            break;
+                        case Op::VARIABLE: {
+                            const Input& input = inputs[instruction.index];
+                            if (input.values) {
+                                std::copy(input.values + base, input.values + base + n, r);
+                                std::fill(r + n, r + lanes, 0.f);
+                            }
+                            else {
+                                for (int i = 0; i < lanes; ++i) {
+                                    r[i] = input.start + input.step * static_cast<float>(base + i);
+                                }
+                            }
+                            ++top;
+                            break;
+                        }
+                        case Op::NEG:   Unary(stack[top], lanes, [](const float a) { return -a; }); break;
+                        case Op::SIN:   Unary(stack[top], lanes, [](const float a) { return std::sin(a); }); break;
+                        case Op::COS:   Unary(stack[top], lanes, [](const float a) { return std::cos(a); }); break;
+                        case Op::TAN:   Unary(stack[top], lanes, [](const float a) { return std::tan(a); }); break;
+                        case Op::ASIN:  Unary(stack[top], lanes, [](const float a) { return std::asin(a); }); break;
+                        case Op::ACOS:  Unary(stack[top], lanes, [](const float a) { return std::acos(a); }); break;
+                        case Op::ATAN:  Unary(stack[top], lanes, [](const float a) { return std::atan(a); }); break;
+                        case Op::SINH:  Unary(stack[top], lanes, [](const float a) { return std::sinh(a); }); break;
+                        case Op::COSH:  Unary(stack[top], lanes, [](const float a) { return std::cosh(a); }); break;
+                        case Op::TANH:  Unary(stack[top], lanes, [](const float a) { return std::tanh(a); }); break;
+                        case Op::SQRT:  Unary(stack[top], lanes, [](const float a) { return std::sqrt(a); }); break;
+                        case Op::ABS:   Unary(stack[top], lanes, [](const float a) { return std::fabs(a); }); break;
+                        case Op::EXP:   Unary(stack[top], lanes, [](const float a) { return std::exp(a); }); break;
+                        case Op::LOG:   Unary(stack[top], lanes, [](const float a) { return std::log(a); }); break;
+                        case Op::FLOOR: Unary(stack[top], lanes, [](const float a) { return std::floor(a); }); break;
+                        case Op::CEIL:  Unary(stack[top], lanes, [](const float a) { return std::ceil(a); }); break;
+                        case Op::ADD:   Binary(instruction, stack, top, lanes, [](const float a, const float b) { return a + b; }); break;
+                        case Op::SUB:   Binary(instruction, stack, top, lanes, [](const float a, const float b) { return a - b; }); break;
+                        case Op::MUL:   Binary(instruction, stack, top, lanes, [](const float a, const float b) { return a * b; }); break;
+                        case Op::DIV:   Binary(instruction, stack, top, lanes, [](const float a, const float b) { return a / b; }); break;
+                        case Op::POW:   Binary(instruction, stack, top, lanes, [](const float a, const float b) { return std::pow(a, b); }); break;
+                        case Op::MIN:   Binary(instruction, stack, top, lanes, [](const float a, const float b) { return std::min(a, b); }); break;
+                        case Op::MAX:   Binary(instruction, stack, top, lanes, [](const float a, const float b) { return std::max(a, b); }); break;
+                        case Op::ATAN2: Binary(instruction, stack, top, lanes, [](const float a, const float b) { return std::atan2(a, b); }); break;
+                    }
+                }
+                std::copy(stack[0], stack[0] + n, out.begin() + base);
+            }
+        }
+
+        // One sample, variables given in the order they were compiled with
+        float Evaluate(const std::initializer_list<float> variables) const
+        {
+            // Variables left out are 0
+            Input inputs[MAX_STACK];
+            const size_t count = std::min<size_t>(std::max(variables.size(), _variables.size()), MAX_STACK);
+            for (size_t i = 0; i < std::min(count, variables.size()); ++i) {
+                inputs[i].start = variables.begin()[i];
+            }
+            float out = 0.f;
+            Evaluate(std::span<const Input>(inputs, count), {&out, 1});
+            return out;
+        }
+
+        // A range holding every value the expression takes while variable v stays within inputs[v]. Every instruction
+        // maps the ranges of its operands to a range of its result, which makes the bound safe up to rounding but
+        // often wider than the true range. Ranges that cannot be bounded, e.g. a division by a range holding 0,
+        // come out as [-inf, inf].
+        Interval Bounds(const std::span<const Interval> inputs) const
+        {
+            if (_code.empty() || inputs.size() < _variables.size()) {
+                return ENTIRE;
+            }
+
+            Interval stack[MAX_STACK];
+            int top = -1;
+            for (const Instruction& instruction : _code) {
+                switch (instruction.op) {
+                    case Op::CONSTANT:
+                        stack[++top] = {instruction.value, instruction.value};
+                        continue;
+                    case Op::PARAMETER:
+                        stack[++top] = {_parameters[instruction.index], _parameters[instruction.index]};
+                        continue;
+                    case Op::VARIABLE:
+                        stack[++top] = inputs[instruction.index];
+                        continue;
+                    default: ;
+                }
+
+                const bool binary = instruction.op >= Op::ADD;
+                Interval b = {0.f, 0.f};
+                if (binary && instruction.operand == Operand::STACK) {
+                    b = stack[top--];
+                }
+                else if (binary) {
+                    const float value = instruction.operand == Operand::CONSTANT ? instruction.value : _parameters[instruction.index];
+                    b = {value, value};
+                }
+                Interval& a = stack[top];
+
+                switch (instruction.op) {
+                    case Op::NEG:   a = {-a.hi, -a.lo}; break;
+                    case Op::SIN:   a = SinBounds(a); break;
+                    case Op::COS:   a = SinBounds({a.lo + HALF_PI, a.hi + HALF_PI}); break;
+                    case Op::TAN:   a = TanBounds(a); break;
+                    case Op::ASIN:  a = {std::asin(std::max(a.lo, -1.f)), std::asin(std::min(a.hi, 1.f))}; break;
+                    case Op::ACOS:  a = {std::acos(std::min(a.hi, 1.f)), std::acos(std::max(a.lo, -1.f))}; break;
+                    case Op::ATAN:  a = {std::atan(a.lo), std::atan(a.hi)}; break;
+                    case Op::SINH:  a = {std::sinh(a.lo), std::sinh(a.hi)}; break;
+                    case Op::COSH:  a = AbsBounds(a); a = {std::cosh(a.lo), std::cosh(a.hi)}; break;
+                    case Op::TANH:  a = {std::tanh(a.lo), std::tanh(a.hi)}; break;
+                    case Op::SQRT:  a = {std::sqrt(std::max(a.lo, 0.f)), std::sqrt(a.hi)}; break;
+                    case Op::ABS:   a = AbsBounds(a); break;
+                    case Op::EXP:   a = {std::exp(a.lo), std::exp(a.hi)}; break;
+                    case Op::LOG:   a = {std::log(std::max(a.lo, 0.f)), std::log(a.hi)}; break;
+                    case Op::FLOOR: a = {std::floor(a.lo), std::floor(a.hi)}; break;
+                    case Op::CEIL:  a = {std::ceil(a.lo), std::ceil(a.hi)}; break;
+                    case Op::ADD:   a = {a.lo + b.lo, a.hi + b.hi}; break;
+                    case Op::SUB:   a = {a.lo - b.hi, a.hi - b.lo}; break;
+                    case Op::MUL:   a = MulBounds(a, b); break;
+                    case Op::DIV:   a = b.lo <= 0.f && b.hi >= 0.f ? ENTIRE : MulBounds(a, {1.f / b.hi, 1.f / b.lo}); break;
+                    case Op::POW:   a = PowBounds(a, b); break;
+                    case Op::MIN:   a = {std::min(a.lo, b.lo), std::min(a.hi, b.hi)}; break;
+                    case Op::MAX:   a = {std::max(a.lo, b.lo), std::max(a.hi, b.hi)}; break;
+                    case Op::ATAN2: a = {-PI, PI}; break;
+                    default: ;
+                }
+                // NaN, from an operation undefined on all of its operand, bounds nothing
+                if (!(a.lo <= a.hi)) {
+                    a = ENTIRE;
+                }
+            }
+            return stack[0];
+        }
+
+        // Batch callback for a function layer (Grapher::BatchFunction), the first variable running over the samples.
+        // It works on a copy, so later parameter changes need a new callback.
+        std::function<void(int, std::span<float>)> Function() const
+        {
+            return [expression = *this](const int first, const std::span<float> out) {
+                const Input inputs[1] = {{static_cast<float>(first), 1.f}};
+                expression.Evaluate(inputs, out);
+            };
+        }
+
+        // Batch callback for a surface layer (Grapher::BatchSurface), the first two variables being x and y
+        std::function<void(int, int, std::span<float>)> Surface() const
+        {
+            return [expression = *this](const int y, const int x0, const std::span<float> out) {
+                const Input inputs[2] = {{static_cast<float>(x0), 1.f}, {static_cast<float>(y), 0.f}};
+                expression.Evaluate(inputs, out);
+            };
+        }
+
+        // World-space callback for a function layer (Grapher::WorldFunction)
+        std::function<void(std::span<const float>, std::span<float>)> WorldFunction() const
+        {
+            return [expression = *this](const std::span<const float> x, const std::span<float> out) {
+                const Input inputs[1] = {{0.f, 0.f, x.data()}};
+                expression.Evaluate(inputs, out);
+            };
+        }
+
+        // World-space callback for a surface layer (Grapher::WorldSurface), the first two variables being x and y
+        std::function<void(float, std::span<const float>, std::span<float>)> WorldSurface() const
+        {
+            return [expression = *this](const float y, const std::span<const float> x, const std::span<float> out) {
+                const Input inputs[2] = {{0.f, 0.f, x.data()}, {y, 0.f}};
+                expression.Evaluate(inputs, out);
+            };
+        }
+
+        // Range callback for an implicit layer (Grapher::IntervalSurface): the bounds over the box [x0, x1] x [y0, y1]
+        std::function<std::pair<float, float>(float, float, float, float)> SurfaceBounds() const
+        {
+            return [expression = *this](const float x0, const float x1, const float y0, const float y1) {
+                const Interval inputs[2] = {{x0, x1}, {y0, y1}};
+                const Interval range = expression.Bounds(inputs);
+                return std::pair<float, float>{range.lo, range.hi};
+            };
+        }
+
+    private:
+        enum class Op : uint8_t {
+            CONSTANT,
+            PARAMETER,
+            VARIABLE,
+            NEG,
+            SIN,
+            COS,
+            TAN,
+            ASIN,
+            ACOS,
+            ATAN,
+            SINH,
+            COSH,
+            TANH,
+            SQRT,
+            ABS,
+            EXP,
+            LOG,
+            FLOOR,
+            CEIL,
+            ADD,
+            SUB,
+            MUL,
+            DIV,
+            POW,
+            MIN,
+            MAX,
+            ATAN2
+        };
+
+        // Where the right operand of a binary operator comes from. A constant or parameter is folded into the
+        // operator so it needs no pass filling a block with the same value.
+        enum class Operand : uint8_t {
+            STACK,
+            CONSTANT,
+            PARAMETER
+        };
+
+        struct Instruction {
+            Op op;
+            uint16_t index = 0;
+            float value = 0.f;
+            Operand operand = Operand::STACK;
+        };
+
+        struct Builtin {
+            std::string_view name;
+            Op op;
+            int arguments;
+        };
+
+        static constexpr Builtin BUILTINS[] = {
+            {"sin", Op::SIN, 1}, {"cos", Op::COS, 1}, {"tan", Op::TAN, 1},
+            {"asin", Op::ASIN, 1}, {"acos", Op::ACOS, 1}, {"atan", Op::ATAN, 1},
+            {"sinh", Op::SINH, 1}, {"cosh", Op::COSH, 1}, {"tanh", Op::TANH, 1},
+            {"sqrt", Op::SQRT, 1}, {"abs", Op::ABS, 1}, {"exp", Op::EXP, 1}, {"log", Op::LOG, 1},
+            {"floor", Op::FLOOR, 1}, {"ceil", Op::CEIL, 1},
+            {"min", Op::MIN, 2}, {"max", Op::MAX, 2}, {"pow", Op::POW, 2}, {"atan2", Op::ATAN2, 2},
+        };
+
+        std::vector<Instruction> _code;
+        std::vector<std::string> _variables;
+        std::vector<std::string> _parameterNames;
+        std::vector<float> _parameters;
+        std::string _error;
+
+        // Parser state, only used while compiling
+        std::string_view _source;
+        size_t _position = 0;
+        int _depth = 0;
+        int _maxDepth = 0;
+
+        static constexpr float PI = 3.14159265359f;
+        static constexpr float HALF_PI = PI * 0.5f;
+        static constexpr Interval ENTIRE = {-INFINITY, INFINITY};
+
+        // Whether a + k * period lies in the interval for some integer k
+        static bool Contains(const Interval a, const float at, const float period)
+        {
+            return at + std::ceil((a.lo - at) / period) * period <= a.hi;
+        }
+
+        static Interval SinBounds(const Interval a)
+        {
+            if (a.hi - a.lo >= 2.f * PI) {
+                return {-1.f, 1.f};
+            }
+            const float lo = std::sin(a.lo);
+            const float hi = std::sin(a.hi);
+            return {Contains(a, -HALF_PI, 2.f * PI) ? -1.f : std::min(lo, hi), Contains(a, HALF_PI, 2.f * PI) ? 1.f : std::max(lo, hi)};
+        }
+
+        // Increasing between the poles, unbounded across one
+        static Interval TanBounds(const Interval a)
+        {
+            if (a.hi - a.lo >= PI || Contains(a, HALF_PI, PI)) {
+                return ENTIRE;
+            }
+            return {std::tan(a.lo), std::tan(a.hi)};
+        }
+
+        static Interval AbsBounds(const Interval a)
+        {
+            if (a.lo >= 0.f) {
+                return a;
+            }
+            if (a.hi <= 0.f) {
+                return {-a.hi, -a.lo};
+            }
+            return {0.f, std::max(-a.lo, a.hi)};
+        }
+
+        static Interval MulBounds(const Interval a, const Interval b)
+        {
+            const float p[4] = {a.lo * b.lo, a.lo * b.hi, a.hi * b.lo, a.hi * b.hi};
+            return {std::min(std::min(p[0], p[1]), std::min(p[2], p[3])), std::max(std::max(p[0], p[1]), std::max(p[2], p[3]))};
+        }
+
+        // Bounded for positive bases, where pow is monotonic in either argument, and for whole non-negative exponents
+        static Interval PowBounds(const Interval a, const Interval b)
+        {
+            if (a.lo > 0.f) {
+                const float p[4] = {std::pow(a.lo, b.lo), std::pow(a.lo, b.hi), std::pow(a.hi, b.lo), std::pow(a.hi, b.hi)};
+                return {std::min(std::min(p[0], p[1]), std::min(p[2], p[3])), std::max(std::max(p[0], p[1]), std::max(p[2], p[3]))};
+            }
+            if (b.lo == b.hi && b.lo >= 0.f && b.lo == std::floor(b.lo)) {
+                const bool even = std::fmod(b.lo, 2.f) == 0.f;
+                const Interval base = even ? AbsBounds(a) : a;
+                return {std::pow(base.lo, b.lo), std::pow(base.hi, b.lo)};
+            }
+            return ENTIRE;
+        }
+
+        template<typename F>
+        static void Unary(float* a, const int lanes, const F& f)
+        {
+            for (int i = 0; i < lanes; ++i) {
+                a[i] = f(a[i]);
+            }
+        }
+
+        template<typename F>
+        void Binary(const Instruction& instruction, float (*stack)[BLOCK], int& top, const int lanes, const F& f) const
+        {
+            if (instruction.operand == Operand::STACK) {
+                float* a = stack[top - 1];
+                const float* b = stack[top];
+                for (int i = 0; i < lanes; ++i) {
+                    a[i] = f(a[i], b[i]);
+                }
+                --top;
+                return;
+            }
+
+            const float b = instruction.operand == Operand::CONSTANT ? instruction.value : _parameters[instruction.index];
+            float* a = stack[top];
+            for (int i = 0; i < lanes; ++i) {
+                a[i] = f(a[i], b);
+            }
+        }
+
+        void Fail(const std::string& message)
+        {
+            if (_error.empty()) {
+                _error = message + " at " + std::to_string(_position);
+            }
+        }
+
+        void SkipSpace()
+        {
+            while (_position < _source.size() && std::isspace(static_cast<unsigned char>(_source[_position]))) {
+                ++_position;
+            }
+        }
+
+        bool Accept(const char c)
+        {
+            SkipSpace();
+            if (_position < _source.size() && _source[_position] == c) {
+                ++_position;
+                return true;
+            }
+            return false;
+        }
+
+        void Push(const Instruction instruction)
+        {
+            _code.push_back(instruction);
+            _maxDepth = std::max(_maxDepth, ++_depth);
+            if (_maxDepth > MAX_STACK) {
+                Fail("expression too deep");
+            }
+        }
+
+        static bool Commutes(const Op op) {
+            return op == Op::ADD || op == Op::MUL || op == Op::MIN || op == Op::MAX;
+        }
+
+        static bool Scalar(const Instruction& instruction) {
+            return (instruction.op == Op::CONSTANT || instruction.op == Op::PARAMETER) && instruction.operand == Operand::STACK;
+        }
+
+        // Appends an operator, folding it away when all its operands are constants. `right` is where the code of
+        // a binary operator's right operand starts.
+        void Emit(const Op op, const int arguments, const size_t right = 0)
+        {
+            _depth -= arguments - 1;
+            if (static_cast<int>(_code.size()) < arguments || !_error.empty()) {
+                return;
+            }
+
+            bool constant = true;
+            for (int i = 1; i <= arguments; ++i) {
+                constant = constant && _code[_code.size() - i].op == Op::CONSTANT;
+            }
+            if (constant && (arguments == 1 || right == _code.size() - 1)) {
+                Expression folded;
+                folded._code.assign(_code.end() - arguments, _code.end());
+                folded._code.push_back({op});
+                float value = 0.f;
+                folded.Evaluate({}, {&value, 1});
+
+                _code.resize(_code.size() - arguments);
+                _code.push_back({Op::CONSTANT, 0, value});
+                return;
+            }
+
+            if (arguments == 2) {
+                // x*2 takes its 2 straight from the instruction, and so does 2*x as multiplying commutes
+                if (right == _code.size() - 1 && Scalar(_code.back())) {
+                    const Instruction scalar = _code.back();
+                    _code.back() = {op, scalar.index, scalar.value, scalar.op == Op::CONSTANT ? Operand::CONSTANT : Operand::PARAMETER};
+                    return;
+                }
+                if (Commutes(op) && right > 0 && right - 1 < _code.size() && Scalar(_code[right - 1])) {
+                    const Instruction scalar = _code[right - 1];
+                    _code.erase(_code.begin() + static_cast<std::ptrdiff_t>(right - 1));
+                    _code.push_back({op, scalar.index, scalar.value, scalar.op == Op::CONSTANT ? Operand::CONSTANT : Operand::PARAMETER});
+                    return;
+                }
+            }
+            _code.push_back({op});
+        }
+
+        void ParseSum()
+        {
+            ParseProduct();
+            while (_error.empty()) {
+                if (Accept('+')) {
+                    const size_t right = _code.size();
+                    ParseProduct();
+                    Emit(Op::ADD, 2, right);
+                }
+                else if (Accept('-')) {
+                    const size_t right = _code.size();
+                    ParseProduct();
+                    Emit(Op::SUB, 2, right);
+                }
+                else {
+                    break;
+                }
+            }
+        }
+
+        void ParseProduct()
+        {
+            ParseUnary();
+            while (_error.empty()) {
+                if (Accept('*')) {
+                    const size_t right = _code.size();
+                    ParseUnary();
+                    Emit(Op::MUL, 2, right);
+                }
+                else if (Accept('/')) {
+                    const size_t right = _code.size();
+                    ParseUnary();
+                    Emit(Op::DIV, 2, right);
+                }
+                else {
+                    break;
+                }
+            }
+        }
+
+        void ParseUnary()
+        {
+            if (Accept('-')) {
+                ParseUnary();
+                Emit(Op::NEG, 1);
+            }
+            else if (Accept('+')) {
+                ParseUnary();
+            }
+            else {
+                ParsePower();
+            }
+        }
+
+        void ParsePower()
+        {
+            ParsePrimary();
+            if (_error.empty() && Accept('^')) {
+                // The exponent may carry its own sign: 2^-x
+                const size_t right = _code.size();
+                ParseUnary();
+                Emit(Op::POW, 2, right);
+            }
+        }
+
+        void ParsePrimary()
+        {
+            SkipSpace();
+            if (_position >= _source.size()) {
+                Fail("unexpected end");
+                return;
+            }
+
+            const char c = _source[_position];
+            if (Accept('(')) {
+                ParseSum();
+                if (!Accept(')')) {
+                    Fail("expected ')'");
+                }
+                return;
+            }
+
+            if (std::isdigit(static_cast<unsigned char>(c)) || c == '.') {
+                const std::string text(_source.substr(_position));
+                char* end = nullptr;
+                const float value = std::strtof(text.c_str(), &end);
+                if (end == text.c_str()) {
+                    Fail("bad number");
+                    return;
+                }
+                _position += static_cast<size_t>(end - text.c_str());
+                Push({Op::CONSTANT, 0, value});
+                return;
+            }
+
+            if (!std::isalpha(static_cast<unsigned char>(c)) && c != '_') {
+                Fail("unexpected '" + std::string(1, c) + "'");
+                return;
+            }
+
+            const size_t start = _position;
+            while (_position < _source.size() && (std::isalnum(static_cast<unsigned char>(_source[_position])) || _source[_position] == '_')) {
+                ++_position;
+            }
+            const std::string_view name = _source.substr(start, _position - start);
+
+            if (Accept('(')) {
+                const Builtin* builtin = nullptr;
+                for (const Builtin& candidate : BUILTINS) {
+                    if (candidate.name == name) {
+                        builtin = &candidate;
+                    }
+                }
+                if (!builtin) {
+                    Fail("unknown function '" + std::string(name) + "'");
+                    return;
+                }
+                size_t right = _code.size();
+                for (int i = 0; i < builtin->arguments && _error.empty(); ++i) {
+                    if (i > 0 && !Accept(',')) {
+                        Fail("expected ','");
+                        return;
+                    }
+                    right = _code.size();
+                    ParseSum();
+                }
+                if (!Accept(')')) {
+                    Fail("expected ')'");
+                    return;
+                }
+                Emit(builtin->op, builtin->arguments, right);
+                return;
+            }
+
+            if (name == "pi") {
+                Push({Op::CONSTANT, 0, 3.14159265359f});
+                return;
+            }
+            if (name == "e") {
+                Push({Op::CONSTANT, 0, 2.71828182846f});
+                return;
+            }
+
+            for (size_t i = 0; i < _variables.size(); ++i) {
+                if (_variables[i] == name) {
+                    Push({Op::VARIABLE, static_cast<uint16_t>(i)});
+                    return;
+                }
+            }
+
+            size_t parameter = 0;
+            while (parameter < _parameterNames.size() && _parameterNames[parameter] != name) {
+                ++parameter;
+            }
+            if (parameter == _parameterNames.size()) {
+                _parameterNames.emplace_back(name);
+                _parameters.push_back(0.f);
+            }
+            Push({Op::PARAMETER, static_cast<uint16_t>(parameter)});
+        }
+    };
+}
\ No newline at end of file
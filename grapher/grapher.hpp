@@ -1,6 +1,26 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
 #include <functional>
-#include <map>
+#include <ostream>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "blend.hpp"
+#include "defines.hpp"
+#include "parallel.hpp"
+#include "resample.hpp"
+#include "series.hpp"
+
+#if GRAPHER_SSE2
+#include <immintrin.h>
+#endif
 
 namespace GR
 {
@@ -15,6 +35,13 @@ namespace GR
         Y
     };
 
+    // FIXED evaluates every column (functions) or every tStep (equations). ADAPTIVE subdivides only where the curve
+    // leaves its chord by more than the layer's tolerance and is meant for LINE plots.
+    enum class Sampling {
+        FIXED,
+        ADAPTIVE
+    };
+
     class Grapher
     {
     public:
@@ -24,17 +51,223 @@ namespace GR
             char8_t bytes[4];
         };
 
+        // Table from a normalized value in [0, 1] to a packed pixel. Built once per layer so the per-pixel colour
+        // pass is a lookup rather than two RgbToHsv and one HsvToRgb conversion. Stops are blended in HSV like
+        // interpolate() does, and resolution sets the number of table entries.
+        class Colormap {
+        public:
+            struct Stop {
+                float position;
+                Pixel color;
+            };
+
+            static constexpr int DEFAULT_RESOLUTION = 1024;
+
+            Colormap() = default;
+
+            Colormap(const Pixel lo, const Pixel hi, const int resolution = DEFAULT_RESOLUTION) {
+                Assign(lo, hi, resolution);
+            }
+
+            Colormap(const std::vector<Stop>& stops, const int resolution = DEFAULT_RESOLUTION) {
+                Assign(stops, resolution);
+            }
+
+            // Rebuilds the table in place, which only allocates when the resolution or the number of stops grows
+            void Assign(const Pixel lo, const Pixel hi, const int resolution = DEFAULT_RESOLUTION) {
+                const Stop stops[] = {{0.f, lo}, {1.f, hi}};
+                Assign(stops, resolution);
+            }
+
+            void Assign(const std::span<const Stop> stops, const int resolution = DEFAULT_RESOLUTION) {
+                _stops.assign(stops.begin(), stops.end());
+                if (_stops.empty()) {
+                    _stops.push_back({0.f, 0xff000000});
+                }
+                // An insertion sort keeps stops at the same position in order like stable_sort, without its buffer
+                for (size_t i = 1; i < _stops.size(); ++i) {
+                    const Stop stop = _stops[i];
+                    size_t j = i;
+                    for (; j > 0 && stop.position < _stops[j - 1].position; --j) {
+                        _stops[j] = _stops[j - 1];
+                    }
+                    _stops[j] = stop;
+                }
+
+                const int size = std::max(resolution, 2);
+                _table.resize(size);
+                _last = static_cast<float>(size - 1);
+
+                size_t segment = 0;
+                for (int i = 0; i < size; ++i) {
+                    const float t = static_cast<float>(i) / _last;
+
+                    while (segment + 1 < _stops.size() && t > _stops[segment + 1].position) {
+                        ++segment;
+                    }
+
+                    const Stop& a = _stops[segment];
+                    const Stop& b = _stops[std::min(segment + 1, _stops.size() - 1)];
+                    const float width = b.position - a.position;
+                    const float local = width > 0.f ? std::clamp((t - a.position) / width, 0.f, 1.f) : (t < a.position ? 0.f : 1.f);
+
+                    const auto res = interpolate({a.color.bytes[2], a.color.bytes[1], a.color.bytes[0]}, {b.color.bytes[2], b.color.bytes[1], b.color.bytes[0]}, local);
+
+                    Pixel pixel = 0xffffffff;
+                    pixel.bytes[3] = 0xff;
+                    pixel.bytes[2] = res.r;
+                    pixel.bytes[1] = res.g;
+                    pixel.bytes[0] = res.b;
+                    _table[i] = pixel.uint;
+                }
+            }
+
+            int Resolution() const {
+                return static_cast<int>(_table.size());
+            }
+
+            // Values outside [0, 1] clamp to the end colours, NaN maps to the first one
+            uint32_t Map(const float normalized) const {
+                float position = normalized * _last + 0.5f;
+                position = position > 0.f ? std::min(position, _last) : 0.f;
+                return _table[static_cast<int>(position)];
+            }
+
+            // out[i] = Map(values[i] / range) for a whole row, `count` pixels at a time across SIMD lanes
+            void MapRow(const float* values, uint32_t* out, const int count, const float range = 1.f) const {
+                int i = 0;
+#if GRAPHER_SSE2
+                // Picked once, on first use, from what the CPU running the program supports
+                static const bool avx2 = Detail::HasAvx2();
+                i = avx2 ? MapRowAvx2(values, out, count, range) : MapRowSse2(values, out, count, range);
+#endif
+                for (; i < count; ++i) {
+                    out[i] = Map(values[i] / range);
+                }
+            }
+
+        private:
+            std::vector<uint32_t> _table = std::vector<uint32_t>(2, 0xff000000);
+            float _last = 1.f;
+            // The stops of the last Assign in order, kept so the next one reuses their storage
+            std::vector<Stop> _stops;
+
+#if GRAPHER_SSE2
+            // Both map the values of the whole groups of lanes at the start of a row and return how many they mapped
+            int MapRowSse2(const float* values, uint32_t* out, const int count, const float range) const {
+                const __m128 range4 = _mm_set1_ps(range);
+                const __m128 last4 = _mm_set1_ps(_last);
+                const __m128 half4 = _mm_set1_ps(0.5f);
+                const __m128 zero4 = _mm_setzero_ps();
+                alignas(16) int index[4];
+                int i = 0;
+                for (; i + 4 <= count; i += 4) {
+                    __m128 position = _mm_add_ps(_mm_mul_ps(_mm_div_ps(_mm_loadu_ps(values + i), range4), last4), half4);
+                    // max returns the second operand for NaN, which sends NaN to entry 0 like Map does
+                    position = _mm_min_ps(_mm_max_ps(position, zero4), last4);
+                    _mm_store_si128(reinterpret_cast<__m128i*>(index), _mm_cvttps_epi32(position));
+                    out[i] = _table[index[0]];
+                    out[i + 1] = _table[index[1]];
+                    out[i + 2] = _table[index[2]];
+                    out[i + 3] = _table[index[3]];
+                }
+                return i;
+            }
+
+            GRAPHER_TARGET_AVX2 int MapRowAvx2(const float* values, uint32_t* out, const int count, const float range) const {
+                const __m256 range8 = _mm256_set1_ps(range);
+                const __m256 last8 = _mm256_set1_ps(_last);
+                const __m256 half8 = _mm256_set1_ps(0.5f);
+                const __m256 zero8 = _mm256_setzero_ps();
+                int i = 0;
+                for (; i + 8 <= count; i += 8) {
+                    __m256 position = _mm256_add_ps(_mm256_mul_ps(_mm256_div_ps(_mm256_loadu_ps(values + i), range8), last8), half8);
+                    position = _mm256_min_ps(_mm256_max_ps(position, zero8), last8);
+                    const __m256i index = _mm256_cvttps_epi32(position);
+                    const __m256i colors = _mm256_i32gather_epi32(reinterpret_cast<const int*>(_table.data()), index, 4);
+                    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), colors);
+                }
+                return i;
+            }
+#endif
+        };
+
+        struct Point {
+            bool operator< (const Point& rhs) const {
+                return x < rhs.x || (x == rhs.x && y < rhs.y);
+            }
+            float x, y;
+        };
+
+        // Fills out[i] with the value at sample first + i. Evaluating a whole row or column per call removes the
+        // per-sample indirect call and gives the compiler a plain loop to vectorize.
+        using BatchFunction = std::function<void(int first, std::span<float> out)>;
+        // Fills out[i] with the value at (x0 + i, y)
+        using BatchSurface = std::function<void(int y, int x0, std::span<float> out)>;
+        // World-space callbacks get the world coordinate of every sample, see Viewport. Fills out[i] with f(x[i]).
+        using WorldFunction = std::function<void(std::span<const float> x, std::span<float> out)>;
+        // Fills out[i] with f(x[i], y)
+        using WorldSurface = std::function<void(float y, std::span<const float> x, std::span<float> out)>;
+        // Range of f over the box [x0, x1] x [y0, y1]. It may be wider than the true range but has to hold all of it.
+        using IntervalSurface = std::function<std::pair<float, float>(float x0, float x1, float y0, float y1)>;
+
+        // Maps pixels to world coordinates for the world-space layers: pixel (x, y) lies at (x0 + x * scale, y0 - y * scale),
+        // so world y grows upwards. Kept in double so long pans and deep zooms do not drift.
+        struct Viewport {
+            double x0 = 0.0;
+            double y0 = 0.0;
+            // World units per pixel
+            double scale = 1.0;
+
+            float WorldX(const double x) const { return static_cast<float>(x0 + x * scale); }
+            float WorldY(const double y) const { return static_cast<float>(y0 - y * scale); }
+            float ScreenX(const double x) const { return static_cast<float>((x - x0) / scale); }
+            float ScreenY(const double y) const { return static_cast<float>((y0 - y) / scale); }
+
+            bool operator==(const Viewport&) const = default;
+        };
+
         struct FunctionInfo {
             std::function<float(int)> function;
+            // Takes precedence over function when set
+            BatchFunction batch;
+            // Takes precedence over function and batch when set: the layer lives in world space and is mapped to pixels
+            // through the viewport. Always sampled once per pixel.
+            WorldFunction world;
             PlotType plot = PlotType::PIXEL;
             Axis axis = Axis::X;
             Pixel color = 0xffffffff;
+            // Adaptive sampling only applies to LINE plots
+            Sampling sampling = Sampling::FIXED;
+            // Largest distance in pixels an adaptive segment may stray from the curve
+            float tolerance = 0.5f;
+            // LINE plots blend Xiaolin Wu coverage into the framebuffer instead of writing hard pixels
+            bool antialias = false;
+            // How the layer's pixels combine with those of the layers drawn before it
+            BlendMode blend = BlendMode::REPLACE;
         };
 
         struct SurfaceInfo {
             std::function<float(int, int)> function;
+            // Takes precedence over function when set
+            BatchSurface batch;
+            // Takes precedence over function and batch when set, sampled at the world position of every pixel
+            WorldSurface world;
             Pixel colorlo = 0xff000000;
             Pixel colorhi = 0xffffffff;
+            // Multi-stop gradient used instead of colorlo and colorhi when not empty
+            std::vector<Colormap::Stop> gradient;
+            int colormapResolution = Colormap::DEFAULT_RESOLUTION;
+            // When not empty, only the iso-lines at these levels are drawn, in contourColor, instead of shading every pixel
+            std::vector<float> contours;
+            // Pixels between the samples contours are traced from. Wider spacing evaluates far fewer samples at the
+            // cost of straighter lines.
+            int contourSpacing = 1;
+            Pixel contourColor = 0xffffffff;
+            // Contours blend Xiaolin Wu coverage into the framebuffer instead of writing hard pixels
+            bool antialias = false;
+            // How the layer's pixels combine with those of the layers drawn before it
+            BlendMode blend = BlendMode::REPLACE;
         };
 
         struct EquationInfo {
@@ -43,19 +276,134 @@ namespace GR
             Pixel color = 0xffffffff;
             float t0;
             float tMax;
+            // Ignored by adaptive sampling
             float tStep;
+            Sampling sampling = Sampling::FIXED;
+            // Largest distance in pixels an adaptive segment may stray from the curve
+            float tolerance = 0.5f;
+            // LINE plots blend Xiaolin Wu coverage into the framebuffer instead of writing hard pixels
+            bool antialias = false;
+            // The equation returns world coordinates, which the viewport maps to pixels
+            bool world = false;
+            // How the layer's pixels combine with those of the layers drawn before it
+            BlendMode blend = BlendMode::REPLACE;
         };
 
         struct ParametricSurfaceInfo {
             std::function<std::tuple<float, float, float>(float, float)> function;
             Pixel colorlo = 0xff000000;
             Pixel colorhi = 0xffffffff;
+            // Multi-stop gradient used instead of colorlo and colorhi when not empty
+            std::vector<Colormap::Stop> gradient;
+            int colormapResolution = Colormap::DEFAULT_RESOLUTION;
             float t0;
             float tMax;
             float tStep;
             float s0;
             float sMax;
             float sStep;
+            // x and y are world coordinates, which the viewport maps to pixels
+            bool world = false;
+            // Draws the (t, s) grid as quads of two triangles filled with z interpolated across them instead of one
+            // point per sample, which covers the surface without holes from a far coarser grid. The last row and
+            // column are sampled at tMax and sMax so that a closed surface closes.
+            bool mesh = false;
+            // Mesh triangles whose corners at (t, s), (t + tStep, s) and (t + tStep, s + sStep) run counter-clockwise
+            // on screen face away and are dropped. Reversing either parameter keeps the other side instead.
+            bool cull = false;
+            // How the layer's pixels combine with those of the layers drawn before it
+            BlendMode blend = BlendMode::REPLACE;
+        };
+
+        // A recorded Series drawn as a line in world space: sample i lies at world (x0 + i * dx, y0 + value * dy). Every pixel
+        // column is reduced to the first, last, min and max sample it covers (M4), which draws the same line as all
+        // the samples would while the work stays bounded by the width.
+        struct SeriesInfo {
+            // Borrowed and must outlive the layer, Invalidate the layer when it is given other data
+            const Series* series = nullptr;
+            double x0 = 0.0;
+            double dx = 1.0;
+            double y0 = 0.0;
+            double dy = 1.0;
+            Pixel color = 0xffffffff;
+            // Blends Xiaolin Wu coverage into the framebuffer instead of writing hard pixels
+            bool antialias = false;
+            // How the layer's pixels combine with those of the layers drawn before it
+            BlendMode blend = BlendMode::REPLACE;
+        };
+
+        // The newest samples of a Stream as a strip chart: every pixel column covers samplesPerColumn samples and the
+        // newest column sits at the right edge, so the plot scrolls left as samples arrive. Values are mapped to world
+        // y as y0 + value * dy. Draws pick up new samples by themselves, the producer never touches the Grapher.
+        struct StreamInfo {
+            // Borrowed and must outlive the layer. A stream holding fewer than width * samplesPerColumn samples keeps
+            // showing the columns it had before they were overwritten, until the layer is invalidated.
+            const Stream* stream = nullptr;
+            int samplesPerColumn = 1;
+            double y0 = 0.0;
+            double dy = 1.0;
+            Pixel color = 0xffffffff;
+            // Blends Xiaolin Wu coverage into the framebuffer instead of writing hard pixels
+            bool antialias = false;
+            // How the layer's pixels combine with those of the layers drawn before it
+            BlendMode blend = BlendMode::REPLACE;
+        };
+
+        // The curve f(x, y) = 0. The frame is split into ever smaller cells and every cell the curve provably misses is
+        // dropped, so only the cells along the curve are sampled at pixel resolution and the work follows the curve's
+        // length rather than the frame's area. A pixel is drawn when f changes sign between its corners.
+        struct ImplicitInfo {
+            // Fills out[i] with f(x[i], y), in pixels unless world is set
+            WorldSurface function;
+            // Bounds of f over a cell, e.g. Expression::SurfaceBounds; a cell whose range excludes 0 holds no curve.
+            // Without them a cell counts as empty when f has the same sign on a lattice of IMPLICIT_LATTICE samples
+            // per side, which misses closed curves smaller than a quarter of the cell.
+            IntervalSurface bounds;
+            Pixel color = 0xffffffff;
+            // x and y are world coordinates, which the viewport maps to pixels
+            bool world = false;
+            // How the layer's pixels combine with those of the layers drawn before it
+            BlendMode blend = BlendMode::REPLACE;
+        };
+
+        // What one _order entry cost in the last DrawAll, collected only while stats are enabled
+        struct LayerStats {
+            // Wall time of the layer's evaluation, which is spread over all workers
+            double evaluateMs = 0.0;
+            // Rasterization time summed over the bands, i.e. thread time rather than wall time with several workers
+            double rasterizeMs = 0.0;
+            uint64_t evaluations = 0;
+            uint64_t pixelsWritten = 0;
+            // Points that fell outside the frame in Plot, or samples that did before reaching it
+            uint64_t pixelsRejected = 0;
+            // Segments the Cohen-Sutherland clipper in Line discarded completely
+            uint64_t linesRejected = 0;
+            // Replayed from the layer cache without being evaluated or rasterized
+            bool cached = false;
+            // Not evaluated because the evaluation cache still held its samples
+            bool recalled = false;
+        };
+
+        // Where DrawStrips sends every finished strip: rows [top, top + rows) of the frame, width pixels each.
+        // Returning false stops the render.
+        using StripSink = std::function<bool(const uint32_t* pixels, int top, int rows)>;
+
+        struct FrameStats {
+            uint64_t frame = 0;
+            double totalMs = 0.0;
+            // Scaling the frame up for supersampling and filtering it back down, see SetSupersampling
+            double resampleMs = 0.0;
+            std::vector<LayerStats> layers;
+        };
+
+        // Counters of the evaluation cache since it was last configured, see SetEvaluationCache
+        struct EvaluationCacheStats {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t evictions = 0;
+            // Samples kept for sizes and views other than the current one, at most the configured limit
+            size_t entries = 0;
+            size_t bytes = 0;
         };
 
     private:
@@ -64,7 +412,12 @@ namespace GR
             FUNCTION,
             SURFACE,
             EQUATION,
-            PARAMSURFACE
+            PARAMSURFACE,
+            SERIES,
+            STREAM,
+            // A surface drawn as contour lines, which is a line layer like any other rather than a full frame
+            CONTOUR,
+            IMPLICIT
         };
 
         std::vector<std::pair<FuncType, size_t>> _order;
@@ -73,27 +426,243 @@ namespace GR
         std::vector<SurfaceInfo> _surfaces;
         std::vector<EquationInfo> _equations;
         std::vector<ParametricSurfaceInfo> _parametricSurfaces;
+        std::vector<SeriesInfo> _series;
+        std::vector<StreamInfo> _streams;
+        std::vector<ImplicitInfo> _implicits;
+
+        struct Write {
+            ptrdiff_t index;
+            uint32_t color;
+            // Below 255 the color is blended over what is already there, as anti-aliased lines do
+            uint8_t coverage = 255;
+            // Replays combine the color with the pixel the same way the layer did
+            BlendMode blend = BlendMode::REPLACE;
+        };
 
         struct SurfaceWrapper {
             uint32_t* pixels;
             int width;
             int height;
-        };
-
-        struct Point {
-            bool operator< (const Point& rhs) const {
-                return x < rhs.x || (x == rhs.x && y < rhs.y);
+            // Rows [top, bottom) that may be written, lets a band of the framebuffer be rendered on its own
+            int top = 0;
+            int bottom = INT_MAX;
+            // Frame index of pixels[0], lets a strip render into a buffer that only holds its own rows. Indices
+            // everywhere else, recorded writes included, stay frame indices.
+            ptrdiff_t offset = 0;
+            // When set, Plot and Line also append every write here so the layer can be replayed later
+            std::vector<Write>* record = nullptr;
+            // When set, the draw paths count their writes and rejections here
+            LayerStats* stats = nullptr;
+            // How the layer being drawn combines with the pixels already there
+            BlendMode blend = BlendMode::REPLACE;
+            // Pixels of this frame per pixel of the frame the layers were evaluated for, along either axis. A
+            // supersampled frame scales the layers' coordinates up as they are drawn, see Supersample.
+            int scale = 1;
+
+            // Frame indices are wider than int, a frame drawn in strips may hold more than INT_MAX pixels
+            ptrdiff_t Index(const int x, const int y) const {
+                return x + static_cast<ptrdiff_t>(y) * width;
             }
-            float x, y;
         };
 
-        struct PointI {
-            bool operator< (const PointI& rhs) const {
-                return x < rhs.x || (x == rhs.x && y < rhs.y);
-            }
+        struct Sample {
             int x, y;
+            float z;
+        };
+
+        struct Vertex {
+            float x, y, z;
+        };
+
+        // A mesh triangle ready to rasterize: it covers the pixel centres where all three edge functions a * x + b * y + c
+        // are at least 0, with z on the plane z0 + dzdx * x + dzdy * y. Adjacent triangles evaluate their shared edge
+        // to exactly opposite values, so no pixel along it is missed. Dropped triangles have an empty box.
+        struct Triangle {
+            // Pixels of the layer's frame the triangle's bounding box reaches into, inclusive
+            int x0 = 0;
+            int y0 = 0;
+            int x1 = -1;
+            int y1 = -1;
+            float a[3];
+            float b[3];
+            float c[3];
+            float z0, dzdx, dzdy;
+        };
+
+        // What a layer's samples depend on besides its callbacks: the version of its parameters, which style updates
+        // leave alone, the frame size for the layers sampled per pixel and the view for the world-space ones
+        struct EvaluationKey {
+            uint64_t version = 0;
+            int width = 0;
+            int height = 0;
+            Viewport viewport;
+
+            bool operator==(const EvaluationKey&) const = default;
+        };
+
+        // Everything a layer computes before writing pixels. Evaluating up front lets DrawAll rasterize
+        // independent row bands in parallel while every band still walks _order front to back.
+        struct LayerSamples {
+            std::vector<float> values;
+            std::vector<Point> points;
+            std::vector<Sample> samples;
+            float min = INFINITY;
+            float max = -INFINITY;
+            Colormap colormap;
+            // Points of every initial span of an adaptive layer, filled in parallel and joined into points
+            std::vector<std::vector<Point>> spans;
+            // Value range of every row evaluated in parallel, reduced once all of them are done
+            std::vector<std::pair<float, float>> ranges;
+            // s of every column of a parametric surface, values holds t of every row
+            std::vector<float> parameters;
+            // Grid and triangles of a parametric surface drawn as a mesh, which leaves samples empty
+            std::vector<Vertex> vertices;
+            std::vector<Triangle> triangles;
+
+            // World-space layers: the view and size the samples were taken at, as long as the layer is unchanged since.
+            // A new view only evaluates the samples it does not share with that one. Other surfaces are complete at
+            // that size while set, which lets DrawProgressive keep them.
+            bool reusable = false;
+            Viewport viewport;
+            int width = 0;
+            int height = 0;
+            // World values of a function layer, which values holds mapped to pixels
+            std::vector<float> world;
+            // The samples of the previous view while the new one takes over what it shares with them
+            std::vector<float> previous;
+            // World x of every column and of the columns that are not shared
+            std::vector<float> xs;
+            std::vector<float> gathered;
+            // Index of the shared previous column and row of every column and row, or -1, and the columns that are not shared
+            std::vector<int> columns;
+            std::vector<int> rows;
+            std::vector<int> missing;
+            // Samples the last world-space evaluation actually computed
+            uint64_t evaluations = 0;
+            // With the evaluation cache on, whether values, points, samples, triangles, min and max hold the layer's
+            // results at key
+            bool memoized = false;
+            EvaluationKey key;
+
+            // Stream layers: samples appended when last drawn, and the column after the newest one reduced, whose
+            // first, min, max and last values world holds in a ring of width columns
+            uint64_t appended = 0;
+            uint64_t columnsEnd = 0;
+        };
+
+        // Samples of the static Draw functions, kept per thread so that repeated draws reuse their buffers. Nothing
+        // else carries over from one draw to the next.
+        static LayerSamples& DrawScratch()
+        {
+            thread_local LayerSamples samples;
+            samples.reusable = false;
+            return samples;
+        }
+
+        // Samples per task when a single layer's evaluation is spread over the workers
+        static constexpr int EVAL_CHUNK = 256;
+
+        // Shortest run of pixels FillRun hands to the span kernel
+        static constexpr int SPAN_KERNEL_MIN = 8;
+
+        // Rows of the caller's frame one task scales up into or filters down from a supersampled frame
+        static constexpr int RESAMPLE_ROWS = 16;
+
+        // Adaptive sampling starts from a uniform split so symmetric features cannot hide between the first samples:
+        // columns per initial span for functions, initial spans for equations
+        static constexpr int ADAPTIVE_COLUMNS = 16;
+        static constexpr int ADAPTIVE_SPANS = 32;
+        // Bisections of one initial equation span, bounds the work on curves that never flatten out
+        static constexpr int ADAPTIVE_MAX_DEPTH = 16;
+
+        // Largest distance in pixels of the previous view at which a sample counts as shared
+        static constexpr double REUSE_TOLERANCE = 1e-3;
+
+        Viewport _viewport;
+
+        unsigned _workers = 1;
+        std::vector<LayerSamples> _samples;
+
+        // Shared by all bands since each one only touches its own rows, see RasterizeParametricSurface
+        std::vector<float> _depth;
+        std::vector<std::vector<ptrdiff_t>> _touched;
+
+        // Rasterized result of one _order entry, replayed by DrawAll for as long as the layer's version is unchanged
+        struct LayerCache {
+            bool valid = false;
+            uint64_t version = 0;
+            int width = 0;
+            int height = 0;
+            // Surfaces cover every pixel and keep a full frame, every other layer keeps its writes per band in order
+            std::vector<uint32_t> pixels;
+            std::vector<std::vector<Write>> writes;
+        };
+
+        bool _statsEnabled = false;
+        FrameStats _stats;
+        // Counters of every band and layer, kept apart so bands never share a counter
+        std::vector<std::vector<LayerStats>> _bandStats;
+        std::ostream* _trace = nullptr;
+
+        const std::atomic<bool>* _cancel = nullptr;
+
+        bool _cacheEnabled = false;
+        // Bumped by every change that shows, the layer cache and DrawProgressive redraw a layer whose version moved
+        std::vector<uint64_t> _versions;
+        // Bumped only by the changes that need new samples
+        std::vector<uint64_t> _parameterVersions;
+        std::vector<LayerCache> _caches;
+        std::vector<size_t> _dirty;
+        // Write target for recorded layers, its contents are never read
+        std::vector<uint32_t> _canvas;
+        // Pixels of the strip DrawStrips is rendering
+        std::vector<uint32_t> _strip;
+
+        // Pixels of the frame factor times wider and taller DrawAll draws into while supersampling
+        int _supersampling = 1;
+        Filter _filter = Filter::BOX;
+        std::vector<uint32_t> _supersampled;
+        // Scratch of every worker filtering the supersampled frame down, see ResolveFrame
+        std::vector<std::vector<uint16_t>> _downsampled;
+
+        // Results of a layer at a size or view other than its current one, which it may come back to
+        struct EvaluationEntry {
+            size_t layer = 0;
+            EvaluationKey key;
+            uint64_t used = 0;
+            std::vector<float> values;
+            std::vector<Point> points;
+            std::vector<Sample> samples;
+            std::vector<Triangle> triangles;
+            float min = INFINITY;
+            float max = -INFINITY;
+        };
+
+        size_t _memoLimit = 0;
+        std::vector<EvaluationEntry> _memo;
+        uint64_t _memoClock = 0;
+        EvaluationCacheStats _memoStats;
+
+        // Where DrawProgressive stopped refining the surfaces
+        struct Progress {
+            bool active = false;
+            int width = 0;
+            int height = 0;
+            std::vector<uint64_t> versions;
+            // Passes 0 to 3 sample every 8th, 4th, 2nd and every pixel, PROGRESSIVE_PASSES once the frame is exact
+            int pass = 0;
+            size_t layer = 0;
+            // Next row of the pass, counted in the pass's rows
+            int row = 0;
+            double rasterizeMs = 0.0;
         };
 
+        static constexpr int PROGRESSIVE_PASSES = 4;
+        Progress _progress;
+        std::vector<std::pair<float, float>> _progressRanges;
+        // World x of every column while world-space surfaces are refined
+        std::vector<float> _progressXs;
+
         typedef struct RgbColor
         {
             RgbColor() = default;
@@ -205,272 +774,2994 @@ namespace GR
             return HsvToRgb(final);
         }
 
+        template<typename Info>
+        static void AssignColormap(const Info& info, Colormap& colormap)
+        {
+            if (!info.gradient.empty()) {
+                colormap.Assign(info.gradient, info.colormapResolution);
+            }
+            else {
+                colormap.Assign(info.colorlo, info.colorhi, info.colormapResolution);
+            }
+        }
+
     public:
-        void AddFunction(const FunctionInfo& functionInfo) {
+        // Threads DrawAll renders with: 1 keeps the serial path, 0 uses every hardware thread.
+        // With more than one worker the user callbacks are called concurrently and must be thread-safe.
+        void SetWorkerCount(const unsigned count) {
+            _workers = count == 0 ? std::max(1u, std::thread::hardware_concurrency()) : count;
+        }
+
+        unsigned GetWorkerCount() const {
+            return _workers;
+        }
+
+        // The Add functions return the layer's position in the draw order, which identifies it in Update and Invalidate
+        size_t AddFunction(const FunctionInfo& functionInfo) {
             _functions.emplace_back(functionInfo);
             _order.emplace_back(FuncType::FUNCTION, _functions.size() - 1);
+            _versions.emplace_back(0);
+            _parameterVersions.emplace_back(0);
+            return _order.size() - 1;
         }
 
-        void AddSurface(const SurfaceInfo& surfaceInfo) {
+        size_t AddSurface(const SurfaceInfo& surfaceInfo) {
             _surfaces.emplace_back(surfaceInfo);
-            _order.emplace_back(FuncType::SURFACE, _surfaces.size() - 1);
+            _order.emplace_back(surfaceInfo.contours.empty() ? FuncType::SURFACE : FuncType::CONTOUR, _surfaces.size() - 1);
+            _versions.emplace_back(0);
+            _parameterVersions.emplace_back(0);
+            return _order.size() - 1;
         }
 
-        void AddEquation(const EquationInfo& equationInfo) {
+        size_t AddEquation(const EquationInfo& equationInfo) {
             _equations.emplace_back(equationInfo);
             _order.emplace_back(FuncType::EQUATION, _equations.size() - 1);
+            _versions.emplace_back(0);
+            _parameterVersions.emplace_back(0);
+            return _order.size() - 1;
         }
 
-        void AddParametricSurface(const ParametricSurfaceInfo& parametricSurfaceInfo) {
+        size_t AddParametricSurface(const ParametricSurfaceInfo& parametricSurfaceInfo) {
             _parametricSurfaces.emplace_back(parametricSurfaceInfo);
             _order.emplace_back(FuncType::PARAMSURFACE, _parametricSurfaces.size() - 1);
+            _versions.emplace_back(0);
+            _parameterVersions.emplace_back(0);
+            return _order.size() - 1;
         }
 
-        static void Plot(const int x,const int y,const Pixel color, const SurfaceWrapper& surface)
-        {
-            if (x < 0 || x >= surface.width || y < 0 || y >= surface.height) {
-                return;
-            }
-            uint32_t* pixel = surface.pixels + (x + y * surface.width);
-            *pixel = color.uint;
+        size_t AddSeries(const SeriesInfo& seriesInfo) {
+            _series.emplace_back(seriesInfo);
+            _order.emplace_back(FuncType::SERIES, _series.size() - 1);
+            _versions.emplace_back(0);
+            _parameterVersions.emplace_back(0);
+            return _order.size() - 1;
         }
 
-#define OUTCODE(x,y) ((((x)<xmin)?1:(((x)>xmax)?2:0))+(((y)<ymin)?4:(((y)>ymax)?8:0)))
-        static void Line(float x1, float y1, float x2, float y2, const Pixel color, const SurfaceWrapper& surface)
-        {
-            // clip (Cohen-Sutherland, https://en.wikipedia.org/wiki/Cohen%E2%80%93Sutherland_algorithm)
-            const float xmin = 0, ymin = 0, xmax = static_cast<float>(surface.width) - 1, ymax = static_cast<float>(surface.height) - 1;
-            int c0 = OUTCODE( x1, y1 ), c1 = OUTCODE( x2, y2 );
-            bool accept = false;
-            while (true)
-            {
-                if (!(c0 | c1)) { accept = true; break; }
-                if (c0 & c1) break;
-                {
-                    float x = 0, y = 0;
-                    const int co = c0 ? c0 : c1;
-                    if (co & 8) x = x1 + (x2 - x1) * (ymax - y1) / (y2 - y1), y = ymax;
-                    else if (co & 4) x = x1 + (x2 - x1) * (ymin - y1) / (y2 - y1), y = ymin;
-                    else if (co & 2) y = y1 + (y2 - y1) * (xmax - x1) / (x2 - x1), x = xmax;
-                    else if (co & 1) y = y1 + (y2 - y1) * (xmin - x1) / (x2 - x1), x = xmin;
-                    if (co == c0) x1 = x, y1 = y, c0 = OUTCODE( x1, y1 );
-                    else x2 = x, y2 = y, c1 = OUTCODE( x2, y2 );
-                }
-            }
-            if (!accept) return;
-            float b = x2 - x1;
-            float h = y2 - y1;
-            float l = fabsf( b );
-            if (fabsf( h ) > l) l = fabsf( h );
-            const int il = static_cast<int>(l);
-            const float dx = b / l;
-            const float dy = h / l;
-            for (int i = 0; i <= il; i++)
-            {
-                *(surface.pixels + static_cast<int>(x1) + static_cast<int>(y1) * surface.width) = color.uint;
-                x1 += dx, y1 += dy;
-            }
+        size_t AddStream(const StreamInfo& streamInfo) {
+            _streams.emplace_back(streamInfo);
+            _order.emplace_back(FuncType::STREAM, _streams.size() - 1);
+            _versions.emplace_back(0);
+            _parameterVersions.emplace_back(0);
+            return _order.size() - 1;
         }
 
-        static void DrawFunction(const SurfaceWrapper& surface, const FunctionInfo& info)
-        {
-            switch (info.plot) {
-                case PlotType::PIXEL:
-                    if (info.axis == Axis::X) {
-                        for (int x = 0; x < surface.width; ++x)
-                        {
-                            Plot(x, static_cast<int>(info.function(x)), info.color, surface);
-                        }
-                    }
-                    else {
-                        for (int y = 0; y < surface.height; ++y)
-                        {
-                            Plot(static_cast<int>(info.function(y)), y, info.color, surface);
-                        }
-                    }
-                    break;
-                case PlotType::LINE:
-                    // Collect points
-                    {
-                        std::vector<Point> points;
-                        points.reserve(surface.width);
-                        if (info.axis == Axis::X) {
-                            for (int x = 0; x < surface.width; ++x) {
-                                points.emplace_back(static_cast<float>(x), info.function(x));
-                            }
-                        }
-                        else
-                        {
-                            for (int y = 0; y < surface.height; ++y) {
-                                points.emplace_back(info.function(y) ,static_cast<float>(y) );
-                            }
-                        }
-
+        size_t AddImplicit(const ImplicitInfo& implicitInfo) {
+            _implicits.emplace_back(implicitInfo);
+            _order.emplace_back(FuncType::IMPLICIT, _implicits.size() - 1);
+            _versions.emplace_back(0);
+            _parameterVersions.emplace_back(0);
+            return _order.size() - 1;
+        }
 
-                        for (size_t i = 0; i < points.size() - 1; ++i) {
-                            Point a = points[i];
-                            Point b = points[i + 1];
-                            Line(a.x, a.y, b.x, b.y, info.color, surface);
-                        }
-                    }
-                    break;
+        // Replace a layer's parameters; calls naming a layer of another type are ignored
+        void UpdateFunction(const size_t layer, const FunctionInfo& functionInfo) {
+            if (layer < _order.size() && _order[layer].first == FuncType::FUNCTION) {
+                _functions[_order[layer].second] = functionInfo;
+                Invalidate(layer);
             }
         }
 
-        static void DrawSurface(const SurfaceWrapper& surface, const SurfaceInfo& info) {
-            std::vector<float> values;
-            values.reserve(surface.width * surface.height);
-
-            float min = INFINITY;
-            float max = -INFINITY;
-
-            for (int y = 0; y < surface.height; ++y) {
-                for (int x = 0; x < surface.width; ++x) {
-
-                    float res = info.function(x, y);
-
-                    min = std::min(min, res);
-                    max = std::max(max, res);
-
-                    values.emplace_back(res);
-                }
+        void UpdateSurface(const size_t layer, const SurfaceInfo& surfaceInfo) {
+            if (layer < _order.size() && (_order[layer].first == FuncType::SURFACE || _order[layer].first == FuncType::CONTOUR)) {
+                _surfaces[_order[layer].second] = surfaceInfo;
+                _order[layer].first = surfaceInfo.contours.empty() ? FuncType::SURFACE : FuncType::CONTOUR;
+                Invalidate(layer);
             }
+        }
 
-            Pixel lo { info.colorlo };
-            Pixel hi { info.colorhi };
+        void UpdateEquation(const size_t layer, const EquationInfo& equationInfo) {
+            if (layer < _order.size() && _order[layer].first == FuncType::EQUATION) {
+                _equations[_order[layer].second] = equationInfo;
+                Invalidate(layer);
+            }
+        }
 
-            for (int y = 0; y < surface.height; ++y) {
-                for (int x = 0; x < surface.width; ++x) {
-                    Pixel pixel = 0xffffffff;
-                    const float normalized = glm::clamp(values[x + y*surface.width] / (max - min), 0.f, 1.f);
+        void UpdateParametricSurface(const size_t layer, const ParametricSurfaceInfo& parametricSurfaceInfo) {
+            if (layer < _order.size() && _order[layer].first == FuncType::PARAMSURFACE) {
+                _parametricSurfaces[_order[layer].second] = parametricSurfaceInfo;
+                Invalidate(layer);
+            }
+        }
 
-                    const auto res = interpolate({lo.bytes[2], lo.bytes[1], lo.bytes[0]}, {hi.bytes[2], hi.bytes[1], hi.bytes[0]}, normalized);
+        void UpdateSeries(const size_t layer, const SeriesInfo& seriesInfo) {
+            if (layer < _order.size() && _order[layer].first == FuncType::SERIES) {
+                _series[_order[layer].second] = seriesInfo;
+                Invalidate(layer);
+            }
+        }
 
-                    pixel.bytes[3] = 0xff;
-                    pixel.bytes[2] = res.r; //static_cast<char8_t>(std::lerp(lo.bytes[2], hi.bytes[2], normalized));
-                    pixel.bytes[1] = res.g; //static_cast<char8_t>(std::lerp(lo.bytes[1], hi.bytes[1], normalized));
-                    pixel.bytes[0] = res.b; //static_cast<char8_t>(std::lerp(lo.bytes[0], hi.bytes[0], normalized));
-                    Plot(x, y, pixel, surface);
-                }
+        void UpdateStream(const size_t layer, const StreamInfo& streamInfo) {
+            if (layer < _order.size() && _order[layer].first == FuncType::STREAM) {
+                _streams[_order[layer].second] = streamInfo;
+                Invalidate(layer);
             }
         }
 
-        static void DrawEquation(const SurfaceWrapper& surface, const EquationInfo& info) {
-            if (info.tStep == 0.f || (info.t0 > info.tMax && info.tStep > 0.f)) {
-                return;
+        void UpdateImplicit(const size_t layer, const ImplicitInfo& implicitInfo) {
+            if (layer < _order.size() && _order[layer].first == FuncType::IMPLICIT) {
+                _implicits[_order[layer].second] = implicitInfo;
+                Invalidate(layer);
             }
+        }
 
-            std::vector<Point> points;
-            points.reserve(static_cast<size_t>((info.tMax - info.t0) / info.tStep));
+        // Replace only how a layer is coloured and drawn, every other field of the info is ignored. The layer keeps
+        // its samples, so with the evaluation cache on the next frame maps them again without evaluating anything.
+        void UpdateSurfaceStyle(const size_t layer, const SurfaceInfo& surfaceInfo) {
+            if (layer < _order.size() && (_order[layer].first == FuncType::SURFACE || _order[layer].first == FuncType::CONTOUR)) {
+                SurfaceInfo& info = _surfaces[_order[layer].second];
+                info.colorlo = surfaceInfo.colorlo;
+                info.colorhi = surfaceInfo.colorhi;
+                info.gradient = surfaceInfo.gradient;
+                info.colormapResolution = surfaceInfo.colormapResolution;
+                info.contourColor = surfaceInfo.contourColor;
+                info.antialias = surfaceInfo.antialias;
+                info.blend = surfaceInfo.blend;
+                ++_versions[layer];
+            }
+        }
 
-            float t = info.t0;
-            while (t < info.tMax) {
+        void UpdateEquationStyle(const size_t layer, const EquationInfo& equationInfo) {
+            if (layer < _order.size() && _order[layer].first == FuncType::EQUATION) {
+                EquationInfo& info = _equations[_order[layer].second];
+                info.plot = equationInfo.plot;
+                info.color = equationInfo.color;
+                info.antialias = equationInfo.antialias;
+                info.blend = equationInfo.blend;
+                ++_versions[layer];
+            }
+        }
 
-                auto res = info.equation(t);
-                points.emplace_back(res.first, res.second);
+        void UpdateParametricSurfaceStyle(const size_t layer, const ParametricSurfaceInfo& parametricSurfaceInfo) {
+            if (layer < _order.size() && _order[layer].first == FuncType::PARAMSURFACE) {
+                ParametricSurfaceInfo& info = _parametricSurfaces[_order[layer].second];
+                info.colorlo = parametricSurfaceInfo.colorlo;
+                info.colorhi = parametricSurfaceInfo.colorhi;
+                info.gradient = parametricSurfaceInfo.gradient;
+                info.colormapResolution = parametricSurfaceInfo.colormapResolution;
+                info.blend = parametricSurfaceInfo.blend;
+                ++_versions[layer];
+            }
+        }
 
-                t += info.tStep;
+        // Marks a layer for re-evaluation, for callbacks that read state the Grapher cannot see change
+        void Invalidate(const size_t layer) {
+            if (layer < _versions.size()) {
+                ++_versions[layer];
+                ++_parameterVersions[layer];
             }
+            if (layer < _samples.size()) {
+                _samples[layer].reusable = false;
+            }
+            // Kept results of older parameters can never be recalled
+            std::erase_if(_memo, [&](const EvaluationEntry& entry) { return entry.layer == layer; });
+            _memoStats.entries = _memo.size();
+            _memoStats.bytes = MemoBytes();
+        }
 
-            switch (info.plot) {
-                case PlotType::PIXEL:
-                    for (Point point : points) {
-                        Plot(static_cast<int>(point.x), static_cast<int>(point.y), info.color, surface);
-                    }
-                    break;
-                case PlotType::LINE:
-                    for (size_t i = 0; i < points.size() - 1; ++i) {
-                        Point a = points[i];
-                        Point b = points[i+1];
-                        Line(a.x, a.y, b.x, b.y, info.color, surface);
-                    }
-                    break;
+        void InvalidateAll() {
+            for (size_t i = 0; i < _versions.size(); ++i) {
+                Invalidate(i);
             }
         }
 
-        static void DrawParametricSurface(const SurfaceWrapper& surface, const ParametricSurfaceInfo& info) {
-            if (info.tStep == 0.f || (info.t0 > info.tMax && info.tStep > 0.f)) {
+        // The view of the world-space layers. Only those are redrawn when it changes, and they keep every sample
+        // the new view shares with the previous one: panning by whole pixels only evaluates the newly exposed rows
+        // and columns, zooming by a whole factor around a pixel only the samples between or around the old ones.
+        void SetViewport(const Viewport& viewport) {
+            if (viewport == _viewport) {
                 return;
             }
-            if (info.sStep == 0.f || (info.s0 > info.sMax && info.sStep > 0.f)) {
-                return;
+            _viewport = viewport;
+            for (size_t i = 0; i < _order.size(); ++i) {
+                if (IsWorld(i)) {
+                    ++_versions[i];
+                }
             }
+        }
 
-            std::map<PointI, float> points;
-
-            float min = INFINITY;
-            float max = -INFINITY;
+        const Viewport& GetViewport() const {
+            return _viewport;
+        }
 
-            float t = info.t0;
-            float s = info.s0;
+        // Moves the view so the world-space layers follow a drag of dx, dy pixels
+        void Pan(const double dx, const double dy) {
+            Viewport viewport = _viewport;
+            viewport.x0 -= dx * viewport.scale;
+            viewport.y0 += dy * viewport.scale;
+            SetViewport(viewport);
+        }
 
-            while (t < info.tMax) {
-                while (s < info.sMax) {
-                    auto res = info.function(t, s);
+        // Magnifies the view by factor around pixel (x, y), which keeps showing the same world point
+        void Zoom(const double factor, const double x, const double y) {
+            if (!(factor > 0.0)) {
+                return;
+            }
+            Viewport viewport = _viewport;
+            viewport.scale = _viewport.scale / factor;
+            viewport.x0 = _viewport.x0 + x * (_viewport.scale - viewport.scale);
+            viewport.y0 = _viewport.y0 - y * (_viewport.scale - viewport.scale);
+            SetViewport(viewport);
+        }
 
-                    const auto x = static_cast<int>(std::get<0>(res));
-                    const auto y = static_cast<int>(std::get<1>(res));
-                    const auto z = std::get<2>(res);
+        // With the layer cache on, DrawAll keeps every layer's rasterized result and only re-evaluates layers that
+        // were updated or invalidated since the last frame, then recomposites all of them in order. DrawProgressive
+        // replays the unchanged layers the same way and only rasterizes the changed ones and the surfaces it is
+        // still refining.
+        void SetLayerCache(const bool enabled) {
+            _cacheEnabled = enabled;
+            if (!enabled) {
+                _caches.clear();
+                _canvas.clear();
+            }
+        }
 
-                    min = std::min(min, z);
-                    max = std::max(max, z);
+        // Keeps the raw samples of surface, contour, equation and parametric surface layers across frames, before they
+        // are normalized and coloured. A layer whose parameters, frame size and, in world space, view are unchanged
+        // is not evaluated again, nor is one changed only through an Update...Style call. Samples of other sizes and
+        // views are kept too, up to `bytes` in all with the least recently used dropped first, so going back to one
+        // costs no evaluation either. 0 turns the cache off and every draw evaluates every layer again. While it is
+        // on, callbacks reading state the Grapher cannot see change need an Invalidate.
+        void SetEvaluationCache(const size_t bytes) {
+            _memoLimit = bytes;
+            _memoStats = {};
+            if (bytes == 0) {
+                _memo.clear();
+                for (LayerSamples& samples : _samples) {
+                    samples.memoized = false;
+                }
+            }
+            Evict();
+        }
 
-                    if (points.contains({x, y})) {
-                        points[{x, y}] = std::max( points[{x, y}], z);
-                    }
-                    else {
-                        points.emplace(PointI(x, y), z);
-                    }
+        const EvaluationCacheStats& GetEvaluationCacheStats() const {
+            return _memoStats;
+        }
 
-                    s += info.sStep;
-                }
-                s = info.s0;
-                t += info.tStep;
+        // Anti-aliases DrawAll and DrawProgressive by drawing into a frame factor (2 or 4) times wider and taller and
+        // filtering it down onto the caller's pixels; 1 turns it off and other factors round down to one of these.
+        // The layers are still evaluated once per pixel of the caller's frame and share their samples and the
+        // evaluation cache with plain draws. Lines are drawn through the scaled-up samples as wide as a pixel, mesh
+        // edges are tested at every pixel of the larger frame and everything else fills whole blocks, so a frame
+        // costs the extra pixels rather than factor squared times the evaluations. DrawStrips is never supersampled.
+        void SetSupersampling(const int factor, const Filter filter = Filter::BOX) {
+            const int supersampling = std::min(ResampleFactor(factor), 4);
+            if (supersampling != _supersampling) {
+                // Cached layers were drawn at the old scale
+                _caches.clear();
+                _supersampled.clear();
+                _supersampled.shrink_to_fit();
+                _downsampled.clear();
             }
+            _supersampling = supersampling;
+            _filter = filter;
+        }
 
-            for (auto pair : points) {
+        // While *cancel is true DrawAll and DrawProgressive stop at the next layer, band or batch and return false,
+        // leaving the framebuffer incomplete. Lets another thread drop a render that a newer request made stale.
+        void SetCancelFlag(const std::atomic<bool>* cancel) {
+            _cancel = cancel;
+        }
 
-                const auto point = pair.first;
-                const auto height = pair.second;
+        // Per-layer counters and timings of every DrawAll from now on. The draw paths only check a null pointer
+        // while stats are disabled.
+        void SetStatsEnabled(const bool enabled) {
+            _statsEnabled = enabled;
+        }
 
-                Pixel pixel = 0xffffffff;
+        // Stats of the most recent DrawAll made with stats enabled
+        const FrameStats& GetStats() const {
+            return _stats;
+        }
 
-                Pixel lo { info.colorlo };
-                Pixel hi { info.colorhi };
+        // When set, every DrawAll made with stats enabled appends its stats to `trace`
+        void SetTrace(std::ostream* trace) {
+            _trace = trace;
+        }
 
-                const float normalized = glm::clamp(height / (max - min), 0.f, 1.f);
+        // One line per layer, in draw order
+        void DumpStats(std::ostream& out) const {
+            static constexpr const char* TYPES[] = {"function", "surface", "equation", "paramsurface", "series", "stream", "contour", "implicit"};
 
-                auto res = interpolate({lo.bytes[2], lo.bytes[1], lo.bytes[0]}, {hi.bytes[2], hi.bytes[1], hi.bytes[0]}, normalized);
+            out << "frame " << _stats.frame << " total " << _stats.totalMs << " ms";
+            if (_supersampling > 1) {
+                out << " resample " << _stats.resampleMs << " ms";
+            }
+            out << "\n";
+            for (size_t i = 0; i < _stats.layers.size() && i < _order.size(); ++i) {
+                const LayerStats& layer = _stats.layers[i];
+                out << "  layer " << i << " " << TYPES[static_cast<int>(_order[i].first)]
+                    << (layer.cached ? " cached" : "")
+                    << (layer.recalled ? " recalled" : "")
+                    << " evaluate " << layer.evaluateMs << " ms"
+                    << " rasterize " << layer.rasterizeMs << " ms"
+                    << " evaluations " << layer.evaluations
+                    << " written " << layer.pixelsWritten
+                    << " rejected " << layer.pixelsRejected
+                    << " clipped " << layer.linesRejected << "\n";
+            }
+        }
 
-                pixel.bytes[3] = 0xff;
-                pixel.bytes[2] = res.r;
-                pixel.bytes[1] = res.g;
-                pixel.bytes[0] = res.b;
-                Plot(point.x, point.y, pixel, surface);
+        static void Store(const SurfaceWrapper& surface, const ptrdiff_t index, const uint32_t color)
+        {
+            uint32_t& pixel = surface.pixels[index - surface.offset];
+            pixel = surface.blend == BlendMode::REPLACE ? color : Compose(surface.blend, pixel, color);
+            if (surface.record) {
+                surface.record->push_back({index, color, 255, surface.blend});
+            }
+            if (surface.stats) {
+                ++surface.stats->pixelsWritten;
             }
         }
 
-        void DrawAll(uint32_t* pixels, const int width, const int height)
+        static void Blend(const SurfaceWrapper& surface, const ptrdiff_t index, const uint32_t color, const uint32_t coverage)
         {
-            const SurfaceWrapper surface = {pixels, width, height};
+            uint32_t& pixel = surface.pixels[index - surface.offset];
+            pixel = Compose(surface.blend, pixel, color, coverage);
+            if (surface.record) {
+                surface.record->push_back({index, color, static_cast<uint8_t>(coverage), surface.blend});
+            }
+            if (surface.stats) {
+                ++surface.stats->pixelsWritten;
+            }
+        }
 
-            for (auto pair : _order) {
-                switch (pair.first) {
-                    case FuncType::FUNCTION:
-                        DrawFunction(surface, _functions[pair.second]);
-                        break;
-                    case FuncType::SURFACE:
-                        DrawSurface(surface, _surfaces[pair.second]);
-                        break;
-                    case FuncType::EQUATION:
-                        DrawEquation(surface, _equations[pair.second]);
+        static void Plot(const int x,const int y,const Pixel color, const SurfaceWrapper& surface)
+        {
+            const int scale = surface.scale;
+            if (x < 0 || x * scale >= surface.width || y < 0 || y * scale >= surface.height) {
+                // Every band sees the point, only the first one counts it
+                if (surface.stats && surface.top == 0) {
+                    ++surface.stats->pixelsRejected;
+                }
+                return;
+            }
+            if (scale == 1) {
+                if (y < surface.top || y >= surface.bottom) {
+                    return;
+                }
+                Store(surface, surface.Index(x, y), color.uint);
+                return;
+            }
+
+            // A point covers its whole block of a supersampled frame, so it comes out as it would without
+            const int bottom = std::min((y + 1) * scale, surface.bottom);
+            for (int row = std::max(y * scale, surface.top); row < bottom; ++row) {
+                for (int column = x * scale; column < (x + 1) * scale; ++column) {
+                    Store(surface, surface.Index(column, row), color.uint);
+                }
+            }
+        }
+
+#define OUTCODE(x,y) ((((x)<xmin)?1:(((x)>xmax)?2:0))+(((y)<ymin)?4:(((y)>ymax)?8:0)))
+        static void Line(float x1, float y1, float x2, float y2, const Pixel color, const SurfaceWrapper& surface)
+        {
+            const Point points[2] = {{x1, y1}, {x2, y2}};
+            Polyline(points, color, surface);
+        }
+
+        static void Polyline(const std::span<const Point> points, const Pixel color, const SurfaceWrapper& surface, const bool antialias = false)
+        {
+            Polyline(static_cast<int>(points.size()), [&](const int i) { return points[i]; }, color, surface, antialias);
+        }
+
+        // Draws the polyline through count points, at(i) returning point i. Every vertex is classified against the
+        // frame once, only segments crossing an edge are clipped and the rest are stepped with integers. A pixel
+        // shared by two consecutive segments is written once. On a supersampled frame the points are scaled up and
+        // every segment is as wide as a pixel of the layer's frame; the downsampling smooths it, so antialias is
+        // left to that rather than to Xiaolin Wu.
+        template<typename PointAt>
+        static void Polyline(const int count, const PointAt& at, const Pixel color, const SurfaceWrapper& surface, const bool antialias = false)
+        {
+            // Non-finite vertices break the polyline instead of being clipped
+            constexpr int NONFINITE = 16;
+            const float xmin = 0, ymin = 0, xmax = static_cast<float>(surface.width) - 1, ymax = static_cast<float>(surface.height) - 1;
+            const float scale = static_cast<float>(surface.scale);
+            const bool wide = surface.scale > 1;
+            const bool wu = antialias && !wide;
+            // Scaled-up points go to the nearest pixel rather than the one they lie in, which centres the wide segments
+            const float bias = wide ? 0.5f : 0.f;
+            auto point = [&](const int i) {
+                const Point p = at(i);
+                return Point{p.x * scale + bias, p.y * scale + bias};
+            };
+            auto segment = [&](const int x0, const int y0, const int x1, const int y1, const ptrdiff_t last) {
+                return wide ? WideSegment(x0, y0, x1, y1, last, color.uint, surface) : Segment(x0, y0, x1, y1, last, color.uint, surface);
+            };
+            auto classify = [&](const Point p) {
+                return std::isfinite(p.x) && std::isfinite(p.y) ? OUTCODE( p.x, p.y ) : NONFINITE;
+            };
+
+            Point a = count > 0 ? point(0) : Point{};
+            int ca = classify(a);
+            // Pixel of a while it is on the frame
+            int ax = ca ? 0 : static_cast<int>(a.x);
+            int ay = ca ? 0 : static_cast<int>(a.y);
+            // Last pixel written, or -1 when the previous segment did not end on the frame
+            ptrdiff_t last = -1;
+
+            for (int i = 1; i < count; ++i) {
+                const Point b = point(i);
+                const int cb = classify(b);
+                const int bx = cb ? 0 : static_cast<int>(b.x);
+                const int by = cb ? 0 : static_cast<int>(b.y);
+
+                if (!(ca | cb) && !wu) {
+                    // Dense samples mostly stay on the pixel just written
+                    if (bx != ax || by != ay || last != surface.Index(ax, ay)) {
+                        last = segment(ax, ay, bx, by, last);
+                    }
+                }
+                else {
+                    Point p0 = a;
+                    Point p1 = b;
+                    if (((ca | cb) & NONFINITE) || (ca & cb) || ((ca | cb) && !Clip(p0, p1, ca, cb, xmax, ymax))) {
+                        if (surface.stats && surface.top == 0) {
+                            ++surface.stats->linesRejected;
+                        }
+                        last = -1;
+                    }
+                    else if (wu) {
+                        WuSegment(p0, p1, color.uint, surface);
+                    }
+                    else {
+                        last = segment(static_cast<int>(p0.x), static_cast<int>(p0.y), static_cast<int>(p1.x), static_cast<int>(p1.y), last);
+                    }
+                }
+
+                a = b;
+                ca = cb;
+                ax = bx;
+                ay = by;
+            }
+        }
+
+        // Clips p0-p1 to the frame (Cohen-Sutherland, https://en.wikipedia.org/wiki/Cohen%E2%80%93Sutherland_algorithm),
+        // false when nothing of it is left
+        static bool Clip(Point& p0, Point& p1, int c0, int c1, const float xmax, const float ymax)
+        {
+            const float xmin = 0, ymin = 0;
+            while (true)
+            {
+                if (!(c0 | c1)) return true;
+                if (c0 & c1) return false;
+                {
+                    float x = 0, y = 0;
+                    const int co = c0 ? c0 : c1;
+                    if (co & 8) x = p0.x + (p1.x - p0.x) * (ymax - p0.y) / (p1.y - p0.y), y = ymax;
+                    else if (co & 4) x = p0.x + (p1.x - p0.x) * (ymin - p0.y) / (p1.y - p0.y), y = ymin;
+                    else if (co & 2) y = p0.y + (p1.y - p0.y) * (xmax - p0.x) / (p1.x - p0.x), x = xmax;
+                    else if (co & 1) y = p0.y + (p1.y - p0.y) * (xmin - p0.x) / (p1.x - p0.x), x = xmin;
+                    if (co == c0) p0 = {x, y}, c0 = OUTCODE( p0.x, p0.y );
+                    else p1 = {x, y}, c1 = OUTCODE( p1.x, p1.y );
+                }
+            }
+        }
+
+        static SurfaceWrapper Blended(const SurfaceWrapper& surface, const BlendMode blend)
+        {
+            SurfaceWrapper blended = surface;
+            blended.blend = blend;
+            return blended;
+        }
+
+        // The frame the layers drawn into a supersampled one are evaluated for
+        static SurfaceWrapper LayerSurface(const SurfaceWrapper& surface)
+        {
+            SurfaceWrapper layer = surface;
+            layer.width = surface.width / surface.scale;
+            layer.height = surface.height / surface.scale;
+            layer.scale = 1;
+            return layer;
+        }
+
+        // Draws anti-aliased: draw(frame) draws into a frame factor times wider and taller than surface, which starts
+        // out as surface's pixels scaled up and is filtered back down onto them afterwards. factor is rounded down to
+        // 1, 2, 4 or 8, see ResampleFactor. The static Draw functions, Line and Plot given that frame evaluate for
+        // surface and only draw at the higher resolution, see SetSupersampling. surface must be a whole frame, not a
+        // band or a strip.
+        template<typename Draw>
+        static void Supersample(const SurfaceWrapper& surface, const int factor, const Filter filter, const Draw& draw)
+        {
+            thread_local std::vector<uint32_t> pixels;
+            thread_local std::vector<std::vector<uint16_t>> sums;
+            const SurfaceWrapper frame = SupersampledFrame(surface, factor, pixels, 1);
+            draw(frame);
+            ResolveFrame(surface, frame, filter, sums, 1);
+        }
+
+        // surface's pixels scaled up by factor, rounded by ResampleFactor, into pixels, or surface itself when that is 1
+        static SurfaceWrapper SupersampledFrame(const SurfaceWrapper& surface, const int requested, std::vector<uint32_t>& pixels, const unsigned workers)
+        {
+            const int factor = ResampleFactor(requested);
+            if (factor <= 1) {
+                return surface;
+            }
+            SurfaceWrapper frame = {nullptr, surface.width * factor, surface.height * factor};
+            frame.scale = factor;
+            pixels.resize(static_cast<size_t>(frame.width) * frame.height);
+            frame.pixels = pixels.data();
+
+            ParallelFor(workers, (surface.height + RESAMPLE_ROWS - 1) / RESAMPLE_ROWS, [&](const int task) {
+                const int top = task * RESAMPLE_ROWS;
+                Upsample(frame.pixels, surface.pixels, surface.width, top, std::min(surface.height, top + RESAMPLE_ROWS), factor);
+            });
+            return frame;
+        }
+
+        // Filters a frame from SupersampledFrame down onto surface. Every worker filters a band of rows with its own
+        // scratch from sums, which is sized here on the calling thread and only grows.
+        static void ResolveFrame(const SurfaceWrapper& surface, const SurfaceWrapper& frame, const Filter filter,
+                                 std::vector<std::vector<uint16_t>>& sums, const unsigned workers)
+        {
+            if (frame.scale <= 1) {
+                return;
+            }
+            const int chunks = (surface.height + RESAMPLE_ROWS - 1) / RESAMPLE_ROWS;
+            const int bands = std::max(1, std::min(chunks, static_cast<int>(workers)));
+            if (sums.size() < static_cast<size_t>(bands)) {
+                sums.resize(bands);
+            }
+            const size_t scratch = DownsampleScratch(surface.width, frame.scale, filter);
+            for (int band = 0; band < bands; ++band) {
+                if (sums[band].size() < scratch) {
+                    sums[band].resize(scratch);
+                }
+            }
+
+            ParallelFor(workers, bands, [&](const int band) {
+                const int top = std::min(surface.height, band * chunks / bands * RESAMPLE_ROWS);
+                const int bottom = std::min(surface.height, (band + 1) * chunks / bands * RESAMPLE_ROWS);
+                Downsample(surface.pixels, frame.pixels, surface.width, surface.height, top, bottom, frame.scale, filter, sums[band].data());
+            });
+        }
+
+        // Writes the length pixels from first on in direction step (1 or -1). Runs too short to pay for a kernel call
+        // are written one by one.
+        static void FillRun(uint32_t* pixels, const ptrdiff_t first, const int length, const int step, const uint32_t color, const BlendMode blend)
+        {
+            uint32_t* start = pixels + (step > 0 ? first : first - length + 1);
+            if (length >= SPAN_KERNEL_MIN) {
+                FillSpan(start, length, color, blend);
+                return;
+            }
+            for (int i = 0; i < length; ++i) {
+                start[i] = blend == BlendMode::REPLACE ? color : Compose(blend, start[i], color);
+            }
+        }
+
+        // Bresenham from (x0, y0) to (x1, y1), both on the frame. The first pixel is skipped when it is `last`;
+        // returns the index of the final pixel.
+        static ptrdiff_t Segment(const int x0, const int y0, const int x1, const int y1, const ptrdiff_t last, const uint32_t color, const SurfaceWrapper& surface)
+        {
+            const ptrdiff_t end = surface.Index(x1, y1);
+            ptrdiff_t index = surface.Index(x0, y0);
+
+            const int top = std::min(y0, y1);
+            const int bottom = std::max(y0, y1);
+            if (bottom < surface.top || top >= surface.bottom) {
+                return end;
+            }
+
+            const int dx = std::abs(x1 - x0);
+            const int dy = bottom - top;
+            const int stepX = x0 < x1 ? 1 : -1;
+            const ptrdiff_t stepY = y0 < y1 ? surface.width : -surface.width;
+            // Only segments reaching out of the band pay for the row test
+            const bool inside = top >= surface.top && bottom < surface.bottom;
+
+            int y = y0;
+            const int rowStep = y0 < y1 ? 1 : -1;
+            int steps = std::max(dx, dy);
+            if (index != last && (inside || (y >= surface.top && y < surface.bottom))) {
+                Store(surface, index, color);
+            }
+
+            // The major axis advances every step, the minor one whenever the error crosses zero
+            const int major = dx >= dy ? dx : dy;
+            const int minor = dx >= dy ? dy : dx;
+            const ptrdiff_t majorStep = dx >= dy ? stepX : stepY;
+            const ptrdiff_t minorStep = dx >= dy ? stepY : stepX;
+            const bool minorIsRow = dx >= dy;
+            int err = major / 2;
+
+            // Nothing to record or count and no row to test, so the pixels can be written directly
+            if (inside && !surface.record && !surface.stats) {
+                uint32_t* const pixels = surface.pixels;
+                ptrdiff_t at = index - surface.offset;
+                if (minorIsRow) {
+                    // A mostly horizontal segment writes runs along its rows, each one as a span
+                    ptrdiff_t first = at + majorStep;
+                    int length = 0;
+                    for (; steps > 0; --steps) {
+                        at += majorStep;
+                        err -= minor;
+                        if (err < 0) {
+                            FillRun(pixels, first, length, majorStep, color, surface.blend);
+                            at += minorStep;
+                            err += major;
+                            first = at;
+                            length = 0;
+                        }
+                        ++length;
+                    }
+                    FillRun(pixels, first, length, majorStep, color, surface.blend);
+                    return end;
+                }
+                for (; steps > 0; --steps) {
+                    at += majorStep;
+                    err -= minor;
+                    if (err < 0) {
+                        at += minorStep;
+                        err += major;
+                    }
+                    pixels[at] = surface.blend == BlendMode::REPLACE ? color : Compose(surface.blend, pixels[at], color);
+                }
+                return end;
+            }
+
+            for (; steps > 0; --steps) {
+                index += majorStep;
+                err -= minor;
+                if (err < 0) {
+                    index += minorStep;
+                    err += major;
+                    if (minorIsRow) {
+                        y += rowStep;
+                    }
+                }
+                if (!minorIsRow) {
+                    y += rowStep;
+                }
+                if (inside || (y >= surface.top && y < surface.bottom)) {
+                    Store(surface, index, color);
+                }
+            }
+            return end;
+        }
+
+        // Segment on a supersampled frame: every step writes a run of surface.scale pixels across the minor axis,
+        // centred on the line, so the line keeps the thickness of a pixel of the layer's frame
+        static ptrdiff_t WideSegment(const int x0, const int y0, const int x1, const int y1, const ptrdiff_t last, const uint32_t color, const SurfaceWrapper& surface)
+        {
+            const ptrdiff_t end = surface.Index(x1, y1);
+            const int scale = surface.scale;
+            const int half = scale / 2;
+            const int top = std::max(surface.top, 0);
+            const int bottom = std::min(surface.bottom, surface.height);
+            if (std::max(y0, y1) + scale - half <= top || std::min(y0, y1) - half >= bottom) {
+                return end;
+            }
+
+            const int dx = std::abs(x1 - x0);
+            const int dy = std::abs(y1 - y0);
+            const int stepX = x0 < x1 ? 1 : -1;
+            const int stepY = y0 < y1 ? 1 : -1;
+            const bool minorIsRow = dx >= dy;
+            const int major = minorIsRow ? dx : dy;
+            const int minor = minorIsRow ? dy : dx;
+            int err = major / 2;
+
+            int x = x0;
+            int y = y0;
+            for (int step = 0; step <= major; ++step) {
+                if (step > 0) {
+                    err -= minor;
+                    const bool across = err < 0;
+                    if (across) {
+                        err += major;
+                    }
+                    x += minorIsRow || across ? stepX : 0;
+                    y += !minorIsRow || across ? stepY : 0;
+                }
+                else if (surface.Index(x, y) == last) {
+                    continue;
+                }
+
+                if (minorIsRow) {
+                    const int rowEnd = std::min(y - half + scale, bottom);
+                    for (int row = std::max(y - half, top); row < rowEnd; ++row) {
+                        Store(surface, surface.Index(x, row), color);
+                    }
+                }
+                else if (y >= top && y < bottom) {
+                    const int columnEnd = std::min(x - half + scale, surface.width);
+                    for (int column = std::max(x - half, 0); column < columnEnd; ++column) {
+                        Store(surface, surface.Index(column, y), color);
+                    }
+                }
+            }
+            return end;
+        }
+
+        // Xiaolin Wu's line (https://en.wikipedia.org/wiki/Xiaolin_Wu%27s_line_algorithm) from p0 to p1, blending two
+        // pixels per step by coverage. The end columns only get the part of their coverage on this segment's side,
+        // so two segments meeting at a vertex add up to one full column rather than being skipped.
+        static void WuSegment(Point p0, Point p1, const uint32_t color, const SurfaceWrapper& surface)
+        {
+            const bool steep = std::fabs(p1.y - p0.y) > std::fabs(p1.x - p0.x);
+            if (steep) {
+                std::swap(p0.x, p0.y);
+                std::swap(p1.x, p1.y);
+            }
+            if (p0.x > p1.x) {
+                std::swap(p0, p1);
+            }
+
+            auto plot = [&](const int x, const int y, const float amount) {
+                const int px = steep ? y : x;
+                const int py = steep ? x : y;
+                const uint32_t coverage = static_cast<uint32_t>(amount * 255.f + 0.5f);
+                if (coverage == 0 || px < 0 || px >= surface.width || py < surface.top || py >= std::min(surface.height, surface.bottom)) {
+                    return;
+                }
+                Blend(surface, surface.Index(px, py), color, coverage);
+            };
+
+            const float dx = p1.x - p0.x;
+            const float gradient = dx == 0.f ? 1.f : (p1.y - p0.y) / dx;
+
+            // Each end covers its rounded column by how much of that column the line reaches into
+            const int xStart = static_cast<int>(std::round(p0.x));
+            const int xEnd = static_cast<int>(std::round(p1.x));
+            auto endpoint = [&](const Point p, const int x, const float gap) {
+                const float y = p.y + gradient * (static_cast<float>(x) - p.x);
+                const float fy = std::floor(y);
+                plot(x, static_cast<int>(fy), (1.f - (y - fy)) * gap);
+                plot(x, static_cast<int>(fy) + 1, (y - fy) * gap);
+                return y;
+            };
+
+            const float yStart = endpoint(p0, xStart, 1.f - (p0.x + 0.5f - std::floor(p0.x + 0.5f)));
+            endpoint(p1, xEnd, p1.x + 0.5f - std::floor(p1.x + 0.5f));
+
+            float y = yStart + gradient;
+            for (int x = xStart + 1; x < xEnd; ++x) {
+                const float fy = std::floor(y);
+                plot(x, static_cast<int>(fy), 1.f - (y - fy));
+                plot(x, static_cast<int>(fy) + 1, y - fy);
+                y += gradient;
+            }
+        }
+
+        // Runs the batch callback, or adapts the scalar one so both kinds of layer share the batched draw paths
+        static void EvaluateBatch(const FunctionInfo& info, const int first, const std::span<float> out)
+        {
+            if (info.batch) {
+                info.batch(first, out);
+                return;
+            }
+            for (size_t i = 0; i < out.size(); ++i) {
+                out[i] = info.function(first + static_cast<int>(i));
+            }
+        }
+
+        static void EvaluateBatch(const SurfaceInfo& info, const int y, const int x0, const std::span<float> out)
+        {
+            if (info.batch) {
+                info.batch(y, x0, out);
+                return;
+            }
+            for (size_t i = 0; i < out.size(); ++i) {
+                out[i] = info.function(x0 + static_cast<int>(i), y);
+            }
+        }
+
+        // True when m lies within tolerance pixels of the segment a-b, or both halves are already below a pixel
+        static bool Flat(const Point a, const Point m, const Point b, const float tolerance)
+        {
+            if (!std::isfinite(a.x) || !std::isfinite(a.y) || !std::isfinite(m.x) || !std::isfinite(m.y) || !std::isfinite(b.x) || !std::isfinite(b.y)) {
+                return true;
+            }
+
+            const float am = std::hypot(m.x - a.x, m.y - a.y);
+            const float mb = std::hypot(b.x - m.x, b.y - m.y);
+            if (am < 1.f && mb < 1.f) {
+                return true;
+            }
+
+            // Distance to the segment rather than the line, so a curve that doubles back past an end is not flat
+            const float dx = b.x - a.x;
+            const float dy = b.y - a.y;
+            const float lengthSquared = dx * dx + dy * dy;
+            const float t = lengthSquared > 0.f ? std::clamp(((m.x - a.x) * dx + (m.y - a.y) * dy) / lengthSquared, 0.f, 1.f) : 0.f;
+            return std::hypot(m.x - (a.x + t * dx), m.y - (a.y + t * dy)) <= tolerance;
+        }
+
+        // Appends the points of (a, b] for a function sampled on integer columns; a column is evaluated at most once
+        static void SubdivideFunction(const FunctionInfo& info, const int a, const float fa, const int b, const float fb, std::vector<Point>& out)
+        {
+            auto point = [&](const int i, const float f) {
+                return info.axis == Axis::X ? Point{static_cast<float>(i), f} : Point{f, static_cast<float>(i)};
+            };
+
+            if (b - a >= 2) {
+                const int m = a + (b - a) / 2;
+                float fm;
+                EvaluateBatch(info, m, {&fm, 1});
+
+                if (!Flat(point(a, fa), point(m, fm), point(b, fb), info.tolerance)) {
+                    SubdivideFunction(info, a, fa, m, fm, out);
+                    SubdivideFunction(info, m, fm, b, fb, out);
+                    return;
+                }
+                out.emplace_back(point(m, fm));
+            }
+            out.emplace_back(point(b, fb));
+        }
+
+        static void EvaluateFunctionAdaptive(const FunctionInfo& info, const int count, LayerSamples& samples, const unsigned workers)
+        {
+            samples.values.clear();
+            samples.points.clear();
+            if (count <= 0) {
+                return;
+            }
+
+            // The span ends are evaluated up front, every span then refines its interior on its own
+            const int spans = std::max(1, (count - 1 + ADAPTIVE_COLUMNS - 1) / ADAPTIVE_COLUMNS);
+            std::vector<float>& ends = samples.values;
+            ends.resize(spans + 1);
+            for (int i = 0; i <= spans; ++i) {
+                EvaluateBatch(info, std::min(i * ADAPTIVE_COLUMNS, count - 1), {&ends[i], 1});
+            }
+
+            samples.spans.resize(spans);
+            ParallelFor(workers, spans, [&](const int span) {
+                std::vector<Point>& out = samples.spans[span];
+                out.clear();
+                const int a = span * ADAPTIVE_COLUMNS;
+                const int b = std::min(a + ADAPTIVE_COLUMNS, count - 1);
+                if (b > a) {
+                    SubdivideFunction(info, a, ends[span], b, ends[span + 1], out);
+                }
+            });
+
+            samples.points.emplace_back(info.axis == Axis::X ? Point{0.f, ends[0]} : Point{ends[0], 0.f});
+            for (const std::vector<Point>& span : samples.spans) {
+                samples.points.insert(samples.points.end(), span.begin(), span.end());
+            }
+            samples.values.clear();
+        }
+
+        static void EvaluateFunction(const SurfaceWrapper& surface, const FunctionInfo& info, LayerSamples& samples, const unsigned workers)
+        {
+            const int count = info.axis == Axis::X ? surface.width : surface.height;
+            if (info.plot == PlotType::LINE && info.sampling == Sampling::ADAPTIVE) {
+                EvaluateFunctionAdaptive(info, count, samples, workers);
+                return;
+            }
+            samples.points.clear();
+            samples.values.resize(count);
+
+            ParallelFor(workers, (count + EVAL_CHUNK - 1) / EVAL_CHUNK, [&](const int chunk) {
+                const int first = chunk * EVAL_CHUNK;
+                const int end = std::min(count, first + EVAL_CHUNK);
+                EvaluateBatch(info, first, {samples.values.data() + first, static_cast<size_t>(end - first)});
+            });
+        }
+
+        static void RasterizeFunction(const SurfaceWrapper& surface, const FunctionInfo& info, const LayerSamples& samples)
+        {
+            const std::vector<float>& values = samples.values;
+            const int count = static_cast<int>(values.size());
+
+            switch (info.plot) {
+                case PlotType::PIXEL:
+                    if (info.axis == Axis::X) {
+                        for (int x = 0; x < count; ++x)
+                        {
+                            Plot(x, static_cast<int>(values[x]), info.color, surface);
+                        }
+                    }
+                    else {
+                        for (int y = 0; y < count; ++y)
+                        {
+                            Plot(static_cast<int>(values[y]), y, info.color, surface);
+                        }
+                    }
+                    break;
+                case PlotType::LINE:
+                    // Adaptive layers keep their uneven samples as points
+                    if (!samples.points.empty()) {
+                        Polyline(samples.points, info.color, surface, info.antialias);
+                    }
+                    else if (info.axis == Axis::X) {
+                        Polyline(count, [&](const int x) { return Point{static_cast<float>(x), values[x]}; }, info.color, surface, info.antialias);
+                    }
+                    else {
+                        Polyline(count, [&](const int y) { return Point{values[y], static_cast<float>(y)}; }, info.color, surface, info.antialias);
+                    }
+                    break;
+            }
+        }
+
+        static void DrawFunction(const SurfaceWrapper& surface, const FunctionInfo& info)
+        {
+            LayerSamples& samples = DrawScratch();
+            if (info.world) {
+                EvaluateWorldFunction(LayerSurface(surface), info, samples, {}, 1);
+            }
+            else {
+                EvaluateFunction(LayerSurface(surface), info, samples, 1);
+            }
+            RasterizeFunction(Blended(surface, info.blend), info, samples);
+        }
+
+        static void EvaluateSurface(const SurfaceWrapper& surface, const SurfaceInfo& info, LayerSamples& samples, const unsigned workers)
+        {
+            samples.values.resize(static_cast<size_t>(surface.width) * surface.height);
+
+            // min and max are order independent, so per-row ranges reduce to exactly the serial result
+            std::vector<std::pair<float, float>>& rowRanges = samples.ranges;
+            rowRanges.resize(surface.height);
+
+            ParallelFor(workers, surface.height, [&](const int y) {
+                float min = INFINITY;
+                float max = -INFINITY;
+
+                float* row = samples.values.data() + static_cast<size_t>(y) * surface.width;
+                EvaluateBatch(info, y, 0, {row, static_cast<size_t>(surface.width)});
+
+                for (int x = 0; x < surface.width; ++x) {
+                    min = std::min(min, row[x]);
+                    max = std::max(max, row[x]);
+                }
+
+                rowRanges[y] = {min, max};
+            });
+
+            samples.min = INFINITY;
+            samples.max = -INFINITY;
+            for (const auto& [min, max] : rowRanges) {
+                samples.min = std::min(samples.min, min);
+                samples.max = std::max(samples.max, max);
+            }
+
+            AssignColormap(info, samples.colormap);
+            samples.reusable = true;
+            samples.width = surface.width;
+            samples.height = surface.height;
+        }
+
+        static void RasterizeSurface(const SurfaceWrapper& surface, const SurfaceInfo&, const LayerSamples& samples)
+        {
+            const int top = std::max(surface.top, 0);
+            const int bottom = std::min(surface.bottom, surface.height);
+
+            // Every pixel of a row is on screen, so whole rows go straight through the colormap into the framebuffer,
+            // or through a row of colours that is blended into it. Surfaces are never recorded, the layer cache keeps
+            // them as a full frame instead.
+            if (surface.scale > 1) {
+                RasterizeSurfaceSupersampled(surface, samples, top, bottom);
+            }
+            else if (surface.blend == BlendMode::REPLACE) {
+                for (int y = top; y < bottom; ++y) {
+                    const size_t row = static_cast<size_t>(y) * surface.width - surface.offset;
+                    samples.colormap.MapRow(samples.values.data() + row, surface.pixels + row, surface.width, samples.max - samples.min);
+                }
+            }
+            else {
+                thread_local std::vector<uint32_t> colors;
+                colors.resize(std::max<size_t>(colors.size(), surface.width));
+                for (int y = top; y < bottom; ++y) {
+                    const size_t row = static_cast<size_t>(y) * surface.width - surface.offset;
+                    samples.colormap.MapRow(samples.values.data() + row, colors.data(), surface.width, samples.max - samples.min);
+                    BlendRow(surface.pixels + row, colors.data(), surface.width, surface.blend);
+                }
+            }
+            if (surface.stats) {
+                surface.stats->pixelsWritten += static_cast<uint64_t>(std::max(0, bottom - top)) * surface.width;
+            }
+        }
+
+        // The samples of a layer's frame repeated over the blocks of a supersampled one: every row of samples is
+        // mapped and widened once, then written to each row of the frame it covers. Such frames are never strips.
+        static void RasterizeSurfaceSupersampled(const SurfaceWrapper& surface, const LayerSamples& samples, const int top, const int bottom)
+        {
+            const int scale = surface.scale;
+            const int width = surface.width / scale;
+            thread_local std::vector<uint32_t> colors;
+            thread_local std::vector<uint32_t> wide;
+            colors.resize(std::max<size_t>(colors.size(), width));
+            wide.resize(std::max<size_t>(wide.size(), surface.width));
+
+            int mapped = -1;
+            for (int y = top; y < bottom; ++y) {
+                if (y / scale != mapped) {
+                    mapped = y / scale;
+                    samples.colormap.MapRow(samples.values.data() + static_cast<size_t>(mapped) * width, colors.data(), width, samples.max - samples.min);
+                    UpsampleRow(wide.data(), colors.data(), width, scale);
+                }
+                BlendRow(surface.pixels + static_cast<size_t>(y) * surface.width, wide.data(), surface.width, surface.blend);
+            }
+        }
+
+        // Shades every pixel, or draws the contours when the info has any
+        static void DrawSurface(const SurfaceWrapper& surface, const SurfaceInfo& info) {
+            LayerSamples& samples = DrawScratch();
+            if (!info.contours.empty()) {
+                EvaluateContours(LayerSurface(surface), info, samples, {}, 1);
+                RasterizeContours(Blended(surface, info.blend), info, samples);
+                return;
+            }
+            if (info.world) {
+                EvaluateWorldSurface(LayerSurface(surface), info, samples, {}, 1);
+            }
+            else {
+                EvaluateSurface(LayerSurface(surface), info, samples, 1);
+            }
+            RasterizeSurface(Blended(surface, info.blend), info, samples);
+        }
+
+        // Fills map[i] with the sample of the previous view at the same coordinate as sample i, or -1. Samples lie at
+        // start + i * step, those of the previous view at previousStart + i * previousStep.
+        static void Remap(const double start, const double step, const int count, const double previousStart, const double previousStep,
+                          const int previousCount, std::vector<int>& map)
+        {
+            map.resize(count);
+            for (int i = 0; i < count; ++i) {
+                const double at = (start + i * step - previousStart) / previousStep;
+                const double nearest = std::round(at);
+                map[i] = std::abs(at - nearest) < REUSE_TOLERANCE && nearest >= 0.0 && nearest < previousCount ? static_cast<int>(nearest) : -1;
+            }
+        }
+
+        // Moves the first missing.size() values of out, evaluated for the missing samples in order, to those samples
+        // and fills every other sample from the previous view. Missing samples are ascending, so going backwards
+        // never overwrites a value before it is moved.
+        static void Scatter(float* out, const std::vector<int>& missing, const std::vector<int>& map, const float* previous)
+        {
+            for (size_t i = missing.size(); i-- > 0;) {
+                out[missing[i]] = out[i];
+            }
+            for (size_t i = 0; i < map.size(); ++i) {
+                if (map[i] >= 0) {
+                    out[i] = previous[map[i]];
+                }
+            }
+        }
+
+        static bool Reusable(const SurfaceWrapper& surface, const LayerSamples& samples)
+        {
+            return samples.reusable && samples.width == surface.width && samples.height == surface.height;
+        }
+
+        static void EvaluateWorldFunction(const SurfaceWrapper& surface, const FunctionInfo& info, LayerSamples& samples,
+                                          const Viewport& viewport, const unsigned workers)
+        {
+            const bool alongX = info.axis == Axis::X;
+            const int count = alongX ? surface.width : surface.height;
+            const bool reuse = Reusable(surface, samples);
+            samples.points.clear();
+
+            if (reuse && alongX) {
+                Remap(viewport.x0, viewport.scale, count, samples.viewport.x0, samples.viewport.scale, count, samples.columns);
+            }
+            else if (reuse) {
+                Remap(viewport.y0, -viewport.scale, count, samples.viewport.y0, -samples.viewport.scale, count, samples.columns);
+            }
+            else {
+                samples.columns.assign(count, -1);
+            }
+
+            samples.missing.clear();
+            samples.gathered.clear();
+            for (int i = 0; i < count; ++i) {
+                if (samples.columns[i] < 0) {
+                    samples.missing.emplace_back(i);
+                    samples.gathered.emplace_back(alongX ? viewport.WorldX(i) : viewport.WorldY(i));
+                }
+            }
+
+            samples.world.swap(samples.previous);
+            samples.world.resize(count);
+            const int missing = static_cast<int>(samples.missing.size());
+            ParallelFor(workers, (missing + EVAL_CHUNK - 1) / EVAL_CHUNK, [&](const int chunk) {
+                const int first = chunk * EVAL_CHUNK;
+                const size_t size = std::min(missing, first + EVAL_CHUNK) - first;
+                info.world({samples.gathered.data() + first, size}, {samples.world.data() + first, size});
+            });
+            Scatter(samples.world.data(), samples.missing, samples.columns, samples.previous.data());
+            samples.evaluations = samples.missing.size();
+
+            samples.values.resize(count);
+            for (int i = 0; i < count; ++i) {
+                samples.values[i] = alongX ? viewport.ScreenY(samples.world[i]) : viewport.ScreenX(samples.world[i]);
+            }
+
+            samples.reusable = true;
+            samples.viewport = viewport;
+            samples.width = surface.width;
+            samples.height = surface.height;
+        }
+
+        static void EvaluateWorldSurface(const SurfaceWrapper& surface, const SurfaceInfo& info, LayerSamples& samples,
+                                         const Viewport& viewport, const unsigned workers)
+        {
+            const int width = surface.width;
+            if (Reusable(surface, samples)) {
+                Remap(viewport.x0, viewport.scale, width, samples.viewport.x0, samples.viewport.scale, width, samples.columns);
+                Remap(viewport.y0, -viewport.scale, surface.height, samples.viewport.y0, -samples.viewport.scale, surface.height, samples.rows);
+            }
+            else {
+                samples.columns.assign(width, -1);
+                samples.rows.assign(surface.height, -1);
+            }
+
+            samples.xs.resize(width);
+            samples.missing.clear();
+            samples.gathered.clear();
+            for (int x = 0; x < width; ++x) {
+                samples.xs[x] = viewport.WorldX(x);
+                if (samples.columns[x] < 0) {
+                    samples.missing.emplace_back(x);
+                    samples.gathered.emplace_back(samples.xs[x]);
+                }
+            }
+
+            samples.values.swap(samples.previous);
+            samples.values.resize(static_cast<size_t>(width) * surface.height);
+            std::vector<std::pair<float, float>>& rowRanges = samples.ranges;
+            rowRanges.resize(surface.height);
+
+            // Rows of the previous view only evaluate the columns it did not have, every other row is evaluated whole
+            ParallelFor(workers, surface.height, [&](const int y) {
+                float* row = samples.values.data() + static_cast<size_t>(y) * width;
+                const int previous = samples.rows[y];
+                if (previous < 0) {
+                    info.world(viewport.WorldY(y), samples.xs, {row, static_cast<size_t>(width)});
+                }
+                else {
+                    if (!samples.missing.empty()) {
+                        info.world(viewport.WorldY(y), samples.gathered, {row, samples.missing.size()});
+                    }
+                    Scatter(row, samples.missing, samples.columns, samples.previous.data() + static_cast<size_t>(previous) * width);
+                }
+
+                float min = INFINITY;
+                float max = -INFINITY;
+                for (int x = 0; x < width; ++x) {
+                    min = std::min(min, row[x]);
+                    max = std::max(max, row[x]);
+                }
+                rowRanges[y] = {min, max};
+            });
+
+            samples.min = INFINITY;
+            samples.max = -INFINITY;
+            for (const auto& [min, max] : rowRanges) {
+                samples.min = std::min(samples.min, min);
+                samples.max = std::max(samples.max, max);
+            }
+            AssignColormap(info, samples.colormap);
+
+            const auto evaluatedRows = static_cast<uint64_t>(std::count(samples.rows.begin(), samples.rows.end(), -1));
+            samples.evaluations = evaluatedRows * width + (surface.height - evaluatedRows) * samples.missing.size();
+            samples.reusable = true;
+            samples.viewport = viewport;
+            samples.width = surface.width;
+            samples.height = surface.height;
+        }
+
+        // A point of an equation in pixels. World-space equations are mapped through the viewport here, so adaptive
+        // tolerances and everything after evaluation keep working in pixels.
+        static Point EquationAt(const EquationInfo& info, const Viewport& viewport, const float t)
+        {
+            const auto [x, y] = info.equation(t);
+            return info.world ? Point{viewport.ScreenX(x), viewport.ScreenY(y)} : Point{x, y};
+        }
+
+        // Appends the points of (a, b] of an equation, bisecting while the midpoint strays from the chord
+        static void SubdivideEquation(const EquationInfo& info, const Viewport& viewport, const float a, const Point pa, const float b, const Point pb,
+                                      const int depth, std::vector<Point>& out)
+        {
+            const float m = (a + b) * 0.5f;
+            const Point pm = EquationAt(info, viewport, m);
+
+            if (depth < ADAPTIVE_MAX_DEPTH && !Flat(pa, pm, pb, info.tolerance)) {
+                SubdivideEquation(info, viewport, a, pa, m, pm, depth + 1, out);
+                SubdivideEquation(info, viewport, m, pm, b, pb, depth + 1, out);
+                return;
+            }
+            out.emplace_back(pm);
+            out.emplace_back(pb);
+        }
+
+        static void EvaluateEquationAdaptive(const EquationInfo& info, LayerSamples& samples, const Viewport& viewport, const unsigned workers) {
+            if (!(info.tMax > info.t0)) {
+                return;
+            }
+
+            const float step = (info.tMax - info.t0) / static_cast<float>(ADAPTIVE_SPANS);
+            auto at = [&](const int i) {
+                return i == ADAPTIVE_SPANS ? info.tMax : info.t0 + step * static_cast<float>(i);
+            };
+
+            samples.spans.resize(ADAPTIVE_SPANS);
+            ParallelFor(workers, ADAPTIVE_SPANS, [&](const int span) {
+                std::vector<Point>& out = samples.spans[span];
+                out.clear();
+
+                const Point a = EquationAt(info, viewport, at(span));
+                const Point b = EquationAt(info, viewport, at(span + 1));
+                SubdivideEquation(info, viewport, at(span), a, at(span + 1), b, 0, out);
+            });
+
+            samples.points.emplace_back(EquationAt(info, viewport, info.t0));
+            for (const std::vector<Point>& span : samples.spans) {
+                samples.points.insert(samples.points.end(), span.begin(), span.end());
+            }
+        }
+
+        static void EvaluateEquation(const EquationInfo& info, LayerSamples& samples, const Viewport& viewport, const unsigned workers) {
+            samples.points.clear();
+
+            if (info.sampling == Sampling::ADAPTIVE) {
+                EvaluateEquationAdaptive(info, samples, viewport, workers);
+                return;
+            }
+            if (info.tStep == 0.f || (info.t0 > info.tMax && info.tStep > 0.f)) {
+                return;
+            }
+
+            // t is accumulated exactly like the serial loop did so every sample lands on the same parameter value
+            std::vector<float>& ts = samples.values;
+            ts.clear();
+            ts.reserve(static_cast<size_t>((info.tMax - info.t0) / info.tStep));
+
+            float t = info.t0;
+            while (t < info.tMax) {
+                ts.emplace_back(t);
+                t += info.tStep;
+            }
+
+            const int count = static_cast<int>(ts.size());
+            samples.points.resize(count);
+
+            ParallelFor(workers, (count + EVAL_CHUNK - 1) / EVAL_CHUNK, [&](const int chunk) {
+                const int end = std::min(count, (chunk + 1) * EVAL_CHUNK);
+                for (int i = chunk * EVAL_CHUNK; i < end; ++i) {
+                    samples.points[i] = EquationAt(info, viewport, ts[i]);
+                }
+            });
+        }
+
+        static void RasterizeEquation(const SurfaceWrapper& surface, const EquationInfo& info, const LayerSamples& samples) {
+            const std::vector<Point>& points = samples.points;
+
+            switch (info.plot) {
+                case PlotType::PIXEL:
+                    for (Point point : points) {
+                        Plot(static_cast<int>(point.x), static_cast<int>(point.y), info.color, surface);
+                    }
+                    break;
+                case PlotType::LINE:
+                    Polyline(points, info.color, surface, info.antialias);
+                    break;
+            }
+        }
+
+        static void DrawEquation(const SurfaceWrapper& surface, const EquationInfo& info) {
+            LayerSamples& samples = DrawScratch();
+            EvaluateEquation(info, samples, {}, 1);
+            RasterizeEquation(Blended(surface, info.blend), info, samples);
+        }
+
+        // World-space surfaces map x and y through the viewport as they are sampled
+        static void EvaluateParametricSurface(const ParametricSurfaceInfo& info, LayerSamples& samples, const Viewport& viewport, const unsigned workers) {
+            samples.samples.clear();
+            samples.vertices.clear();
+            samples.triangles.clear();
+            samples.min = INFINITY;
+            samples.max = -INFINITY;
+
+            if (info.tStep == 0.f || (info.t0 > info.tMax && info.tStep > 0.f)) {
+                return;
+            }
+            if (info.sStep == 0.f || (info.s0 > info.sMax && info.sStep > 0.f)) {
+                return;
+            }
+
+            // Parameters are accumulated like the serial nested loop, every t row restarts the same s sequence
+            std::vector<float>& ts = samples.values;
+            std::vector<float>& ss = samples.parameters;
+            ts.clear();
+            ss.clear();
+
+            float t = info.t0;
+            while (t < info.tMax) {
+                ts.emplace_back(t);
+                t += info.tStep;
+            }
+
+            float s = info.s0;
+            while (s < info.sMax) {
+                ss.emplace_back(s);
+                s += info.sStep;
+            }
+
+            if (info.mesh) {
+                CloseRange(ts, info.tMax, info.tStep);
+                CloseRange(ss, info.sMax, info.sStep);
+            }
+
+            const int rows = static_cast<int>(ts.size());
+            const size_t columns = ss.size();
+            if (info.mesh) {
+                samples.vertices.resize(ts.size() * columns);
+            }
+            else {
+                samples.samples.resize(ts.size() * columns);
+            }
+
+            std::vector<std::pair<float, float>>& rowRanges = samples.ranges;
+            rowRanges.resize(rows);
+
+            ParallelFor(workers, rows, [&](const int row) {
+                float min = INFINITY;
+                float max = -INFINITY;
+
+                for (size_t column = 0; column < columns; ++column) {
+                    auto res = info.function(ts[row], ss[column]);
+                    if (info.world) {
+                        std::get<0>(res) = viewport.ScreenX(std::get<0>(res));
+                        std::get<1>(res) = viewport.ScreenY(std::get<1>(res));
+                    }
+
+                    const auto z = std::get<2>(res);
+                    min = std::min(min, z);
+                    max = std::max(max, z);
+
+                    if (info.mesh) {
+                        samples.vertices[row * columns + column] = {std::get<0>(res), std::get<1>(res), z};
+                    }
+                    else {
+                        samples.samples[row * columns + column] = {static_cast<int>(std::get<0>(res)), static_cast<int>(std::get<1>(res)), z};
+                    }
+                }
+
+                rowRanges[row] = {min, max};
+            });
+
+            for (const auto& [min, max] : rowRanges) {
+                samples.min = std::min(samples.min, min);
+                samples.max = std::max(samples.max, max);
+            }
+
+            AssignColormap(info, samples.colormap);
+
+            if (!info.mesh || rows < 2 || columns < 2) {
+                return;
+            }
+
+            // Every quad between rows row and row + 1 becomes two triangles with the same winding
+            samples.triangles.resize(2 * (ts.size() - 1) * (columns - 1));
+            ParallelFor(workers, rows - 1, [&](const int row) {
+                const Vertex* a = samples.vertices.data() + row * columns;
+                const Vertex* b = a + columns;
+                Triangle* out = samples.triangles.data() + 2 * row * (columns - 1);
+                for (size_t column = 0; column + 1 < columns; ++column) {
+                    out[2 * column] = SetupTriangle(a[column], b[column], b[column + 1], info.cull);
+                    out[2 * column + 1] = SetupTriangle(a[column], b[column + 1], a[column + 1], info.cull);
+                }
+            });
+        }
+
+        // Ends the parameters of a mesh at max, unless the last one already lies on it
+        static void CloseRange(std::vector<float>& parameters, const float max, const float step)
+        {
+            if (!parameters.empty() && parameters.back() + std::abs(step) * 1e-3f < max) {
+                parameters.emplace_back(max);
+            }
+        }
+
+        static Triangle SetupTriangle(const Vertex& p0, Vertex p1, Vertex p2, const bool cull)
+        {
+            Triangle triangle;
+            // Positive when the corners run clockwise on screen, where y grows downwards
+            float area = (p1.x - p0.x) * (p2.y - p0.y) - (p1.y - p0.y) * (p2.x - p0.x);
+            if (area < 0.f && !cull) {
+                std::swap(p1, p2);
+                area = -area;
+            }
+            // Culled, degenerate or not finite
+            if (!(area > 0.f) || !std::isfinite(area)) {
+                return triangle;
+            }
+
+            const Vertex corners[3] = {p0, p1, p2};
+            for (int i = 0; i < 3; ++i) {
+                const Vertex& p = corners[i];
+                const Vertex& q = corners[(i + 1) % 3];
+                triangle.a[i] = p.y - q.y;
+                triangle.b[i] = q.x - p.x;
+                triangle.c[i] = p.x * q.y - q.x * p.y;
+            }
+
+            triangle.dzdx = ((p1.z - p0.z) * (p2.y - p0.y) - (p2.z - p0.z) * (p1.y - p0.y)) / area;
+            triangle.dzdy = ((p2.z - p0.z) * (p1.x - p0.x) - (p1.z - p0.z) * (p2.x - p0.x)) / area;
+            triangle.z0 = p0.z - triangle.dzdx * p0.x - triangle.dzdy * p0.y;
+
+            // Pixel x spans [x, x + 1). Every pixel the box reaches into is kept, a triangle too thin to hold a pixel
+            // centre may still hold the centres of a supersampled frame's pixels. The box is clamped well inside int,
+            // even once scaled up, before the frame clips it.
+            constexpr float LIMIT = 1 << 26;
+            const auto pixel = [&](const float at) { return static_cast<int>(std::floor(std::clamp(at, -LIMIT, LIMIT))); };
+            triangle.x0 = pixel(std::min({p0.x, p1.x, p2.x}));
+            triangle.x1 = pixel(std::max({p0.x, p1.x, p2.x}));
+            triangle.y0 = pixel(std::min({p0.y, p1.y, p2.y}));
+            triangle.y1 = pixel(std::max({p0.y, p1.y, p2.y}));
+            return triangle;
+        }
+
+        // depth is a frame-sized max-depth buffer holding -INFINITY for every pixel that has not been hit. Only the
+        // pixels collected in touched are plotted and reset afterwards, so the buffer is reused without a full clear
+        // and the work stays bounded by the screen size instead of the sample count.
+        static void RasterizeParametricSurface(const SurfaceWrapper& surface, const ParametricSurfaceInfo& info, const LayerSamples& samples,
+                                               const std::span<float> depth, std::vector<ptrdiff_t>& touched) {
+            const int top = std::max(surface.top, 0);
+            const int bottom = std::min(surface.bottom, surface.height);
+
+            if (info.mesh) {
+                for (const Triangle& triangle : samples.triangles) {
+                    RasterizeTriangle(surface, triangle, top, bottom, depth, touched);
+                }
+            }
+
+            auto deepen = [&](const ptrdiff_t index, const float value) {
+                float& z = depth[index - surface.offset];
+                if (z == -INFINITY) {
+                    z = value;
+                    touched.emplace_back(index);
+                }
+                else {
+                    z = std::max(z, value);
+                }
+            };
+
+            const int scale = surface.scale;
+            for (const Sample& sample : samples.samples) {
+                // Off-screen samples and rows outside the band would be rejected by Plot anyway
+                if (sample.x < 0 || sample.x * scale >= surface.width || sample.y < 0 || sample.y * scale >= surface.height) {
+                    if (surface.stats && surface.top == 0) {
+                        ++surface.stats->pixelsRejected;
+                    }
+                    continue;
+                }
+                if (scale == 1) {
+                    if (sample.y >= top && sample.y < bottom) {
+                        deepen(surface.Index(sample.x, sample.y), sample.z);
+                    }
+                    continue;
+                }
+
+                // A sample covers its block of a supersampled frame, as Plot's points do
+                const int rowEnd = std::min((sample.y + 1) * scale, bottom);
+                for (int row = std::max(sample.y * scale, top); row < rowEnd; ++row) {
+                    for (int column = sample.x * scale; column < (sample.x + 1) * scale; ++column) {
+                        deepen(surface.Index(column, row), sample.z);
+                    }
+                }
+            }
+
+            for (const ptrdiff_t index : touched) {
+
+                const auto height = depth[index - surface.offset];
+                depth[index - surface.offset] = -INFINITY;
+
+                Store(surface, index, samples.colormap.Map(height / (samples.max - samples.min)));
+            }
+            touched.clear();
+        }
+
+        // Writes the triangle's z into the depth buffer of rows [top, bottom) wherever it is higher. The centres of a
+        // supersampled frame's pixels are tested in the layer's coordinates.
+        static void RasterizeTriangle(const SurfaceWrapper& surface, const Triangle& triangle, const int top, const int bottom,
+                                      const std::span<float> depth, std::vector<ptrdiff_t>& touched)
+        {
+            if (triangle.x0 > triangle.x1 || triangle.y0 > triangle.y1) {
+                return;
+            }
+            const int scale = surface.scale;
+            const float inverse = 1.f / static_cast<float>(scale);
+            const int left = triangle.x0 * scale;
+            const int right = (triangle.x1 + 1) * scale - 1;
+            const int upper = triangle.y0 * scale;
+            const int lower = (triangle.y1 + 1) * scale - 1;
+            if (right < 0 || left >= surface.width || lower < 0 || upper >= surface.height) {
+                if (surface.stats && surface.top == 0) {
+                    ++surface.stats->pixelsRejected;
+                }
+                return;
+            }
+
+            const int y0 = std::max(upper, top);
+            const int y1 = std::min(lower, bottom - 1);
+            for (int y = y0; y <= y1; ++y) {
+                const float py = (static_cast<float>(y) + 0.5f) * inverse;
+                float rows[3];
+                int x0 = std::max(left, 0);
+                int x1 = std::min(right, surface.width - 1);
+
+                // Every edge bounds the span from one side, the pixels next to the bounds are tested exactly below
+                for (int i = 0; i < 3; ++i) {
+                    rows[i] = triangle.b[i] * py + triangle.c[i];
+                    if (triangle.a[i] == 0.f) {
+                        continue;
+                    }
+                    // Pixels from (a > 0) or up to (a < 0) bound pass, give or take the rounding of the division
+                    const float bound = -rows[i] / triangle.a[i] * static_cast<float>(scale) - 0.5f;
+                    if (triangle.a[i] > 0.f) {
+                        if (bound > static_cast<float>(x1 + 1)) {
+                            x0 = x1 + 1;
+                        }
+                        else if (bound > static_cast<float>(x0)) {
+                            x0 = static_cast<int>(std::floor(bound));
+                        }
+                    }
+                    else {
+                        if (bound < static_cast<float>(x0 - 1)) {
+                            x1 = x0 - 1;
+                        }
+                        else if (bound < static_cast<float>(x1)) {
+                            x1 = static_cast<int>(std::ceil(bound));
+                        }
+                    }
+                }
+
+                const ptrdiff_t row = surface.Index(0, y);
+                for (int x = x0; x <= x1; ++x) {
+                    const float px = (static_cast<float>(x) + 0.5f) * inverse;
+                    if (triangle.a[0] * px + rows[0] < 0.f || triangle.a[1] * px + rows[1] < 0.f || triangle.a[2] * px + rows[2] < 0.f) {
+                        continue;
+                    }
+
+                    const ptrdiff_t index = row + x;
+                    const float z = triangle.z0 + triangle.dzdx * px + triangle.dzdy * py;
+                    float& current = depth[index - surface.offset];
+                    if (current == -INFINITY) {
+                        current = z;
+                        touched.emplace_back(index);
+                    }
+                    else {
+                        current = std::max(current, z);
+                    }
+                }
+            }
+        }
+
+        static void DrawParametricSurface(const SurfaceWrapper& surface, const ParametricSurfaceInfo& info) {
+            LayerSamples& samples = DrawScratch();
+            EvaluateParametricSurface(info, samples, {}, 1);
+
+            // Every draw leaves the depth buffer at -INFINITY again, so it only ever needs to grow
+            thread_local std::vector<float> depth;
+            thread_local std::vector<ptrdiff_t> touched;
+            const size_t size = static_cast<size_t>(surface.width) * surface.height;
+            depth.resize(std::max(depth.size(), size), -INFINITY);
+            RasterizeParametricSurface(Blended(surface, info.blend), info, samples, {depth.data(), size}, touched);
+        }
+
+        // Rows of cells one marching squares task walks
+        static constexpr int CONTOUR_ROWS = 16;
+
+        // Pixel of grid sample i along an axis of size pixels, the last sample is moved back onto the frame
+        static int GridPosition(const int i, const int spacing, const int size)
+        {
+            return std::min(i * spacing, size - 1);
+        }
+
+        // Samples a surface every contourSpacing pixels and traces its contours with marching squares into points,
+        // every two of which are the ends of one segment. Only the cells that can reach rows [top, bottom) are sampled,
+        // so a frame drawn in strips holds the grid of one strip at a time.
+        static void EvaluateContours(const SurfaceWrapper& surface, const SurfaceInfo& info, LayerSamples& samples, const Viewport& viewport,
+                                     const unsigned workers, const int top = 0, const int bottom = INT_MAX)
+        {
+            samples.points.clear();
+            samples.values.clear();
+            if (surface.width <= 0 || surface.height <= 0) {
+                return;
+            }
+            const int spacing = std::max(1, info.contourSpacing);
+            const int columns = (surface.width + spacing - 2) / spacing + 1;
+            const int frameRows = (surface.height + spacing - 2) / spacing + 1;
+
+            // Cells [first, last), cell j lying between grid rows j and j + 1. The cell row above the first one that
+            // reaches top is kept too, its anti-aliased lines may blend into the row below them.
+            const int first = std::max(0, (top - 1) / spacing - 1);
+            const int last = std::min(frameRows - 1, std::min(bottom, surface.height) / spacing + 1);
+            if (first >= last) {
+                return;
+            }
+            const int rows = last - first + 1;
+
+            samples.values.resize(static_cast<size_t>(columns) * rows);
+            if (info.world) {
+                samples.xs.resize(columns);
+                for (int i = 0; i < columns; ++i) {
+                    samples.xs[i] = viewport.WorldX(GridPosition(i, spacing, surface.width));
+                }
+            }
+
+            ParallelFor(workers, rows, [&](const int j) {
+                const int y = GridPosition(first + j, spacing, surface.height);
+                float* row = samples.values.data() + static_cast<size_t>(j) * columns;
+                if (info.world) {
+                    info.world(viewport.WorldY(y), samples.xs, {row, static_cast<size_t>(columns)});
+                }
+                else if (spacing == 1) {
+                    EvaluateBatch(info, y, 0, {row, static_cast<size_t>(columns)});
+                }
+                else {
+                    for (int i = 0; i < columns; ++i) {
+                        EvaluateBatch(info, y, GridPosition(i, spacing, surface.width), {row + i, 1});
+                    }
+                }
+            });
+
+            // Edges crossed in every case of the corners above the level, corner k setting bit k. Corners run top
+            // left, top right, bottom right, bottom left and edge k joins corner k to the next one. The saddles 5 and
+            // 10 are listed for a center below the level and swap rows when it is above.
+            static constexpr int SEGMENTS[16][4] = {
+                {-1, -1, -1, -1}, {3, 0, -1, -1}, {0, 1, -1, -1}, {3, 1, -1, -1},
+                {1, 2, -1, -1}, {3, 0, 1, 2}, {0, 2, -1, -1}, {3, 2, -1, -1},
+                {2, 3, -1, -1}, {0, 2, -1, -1}, {0, 1, 2, 3}, {1, 2, -1, -1},
+                {3, 1, -1, -1}, {0, 1, -1, -1}, {3, 0, -1, -1}, {-1, -1, -1, -1}
+            };
+
+            // A cell crosses exactly the levels in [min, max) of its corners, which sorted levels find without testing the rest
+            std::vector<float>& levels = samples.parameters;
+            levels.assign(info.contours.begin(), info.contours.end());
+            std::sort(levels.begin(), levels.end());
+
+            const int cellRows = rows - 1;
+            const int tasks = (cellRows + CONTOUR_ROWS - 1) / CONTOUR_ROWS;
+            samples.spans.resize(tasks);
+            ParallelFor(workers, tasks, [&](const int task) {
+                std::vector<Point>& out = samples.spans[task];
+                out.clear();
+                const int end = std::min(cellRows, (task + 1) * CONTOUR_ROWS);
+                for (int j = task * CONTOUR_ROWS; j < end; ++j) {
+                    const float* above = samples.values.data() + static_cast<size_t>(j) * columns;
+                    const float* below = above + columns;
+                    const auto y0 = static_cast<float>(GridPosition(first + j, spacing, surface.height));
+                    const auto y1 = static_cast<float>(GridPosition(first + j + 1, spacing, surface.height));
+
+                    for (int i = 0; i + 1 < columns; ++i) {
+                        const float v[4] = {above[i], above[i + 1], below[i + 1], below[i]};
+                        // The sum is only finite when every corner is
+                        if (!std::isfinite(v[0] + v[1] + v[2] + v[3])) {
+                            continue;
+                        }
+                        const float min = std::min(std::min(v[0], v[1]), std::min(v[2], v[3]));
+                        const float max = std::max(std::max(v[0], v[1]), std::max(v[2], v[3]));
+                        auto level = std::lower_bound(levels.begin(), levels.end(), min);
+                        if (level == levels.end() || !(*level < max)) {
+                            continue;
+                        }
+                        const auto x0 = static_cast<float>(GridPosition(i, spacing, surface.width));
+                        const auto x1 = static_cast<float>(GridPosition(i + 1, spacing, surface.width));
+                        const Point corners[4] = {{x0, y0}, {x1, y0}, {x1, y1}, {x0, y1}};
+
+                        for (; level != levels.end() && *level < max; ++level) {
+                            const float l = *level;
+                            int index = (v[0] > l) | (v[1] > l) << 1 | (v[2] > l) << 2 | (v[3] > l) << 3;
+                            if ((index == 5 || index == 10) && (v[0] + v[1] + v[2] + v[3]) * 0.25f > l) {
+                                index = 15 - index;
+                            }
+
+                            auto crossing = [&](const int edge) {
+                                const int a = edge;
+                                const int b = (edge + 1) % 4;
+                                const float t = (l - v[a]) / (v[b] - v[a]);
+                                return Point{corners[a].x + t * (corners[b].x - corners[a].x), corners[a].y + t * (corners[b].y - corners[a].y)};
+                            };
+                            const int* edges = SEGMENTS[index];
+                            for (int k = 0; k < 4 && edges[k] >= 0; k += 2) {
+                                out.emplace_back(crossing(edges[k]));
+                                out.emplace_back(crossing(edges[k + 1]));
+                            }
+                        }
+                    }
+                }
+            });
+
+            for (const std::vector<Point>& span : samples.spans) {
+                samples.points.insert(samples.points.end(), span.begin(), span.end());
+            }
+        }
+
+        static void RasterizeContours(const SurfaceWrapper& surface, const SurfaceInfo& info, const LayerSamples& samples)
+        {
+            for (size_t i = 0; i + 1 < samples.points.size(); i += 2) {
+                Polyline({samples.points.data() + i, 2}, info.contourColor, surface, info.antialias);
+            }
+        }
+
+        // Side of the cells an implicit layer starts from, one task each, and of those it samples at pixel resolution
+        static constexpr int IMPLICIT_TILE = 64;
+        static constexpr int IMPLICIT_LEAF = 8;
+        // Samples per side of the lattice that decides whether a cell of an implicit layer without bounds is empty
+        static constexpr int IMPLICIT_LATTICE = 5;
+
+        // Appends every pixel of the cell [x, x + w) x [y, y + h) the curve crosses, returns the samples it took
+        static uint64_t SubdivideImplicit(const ImplicitInfo& info, const Viewport& viewport, const int x, const int y, const int w, const int h,
+                                          std::vector<Point>& out)
+        {
+            auto toX = [&](const float px) { return info.world ? viewport.WorldX(px) : px; };
+            auto toY = [&](const float py) { return info.world ? viewport.WorldY(py) : py; };
+
+            if (w <= IMPLICIT_LEAF && h <= IMPLICIT_LEAF) {
+                // f at the corners of every pixel, row by row
+                constexpr int SIDE = IMPLICIT_LEAF + 1;
+                float xs[SIDE];
+                float values[SIDE * SIDE];
+                for (int i = 0; i <= w; ++i) {
+                    xs[i] = toX(static_cast<float>(x + i));
+                }
+                for (int j = 0; j <= h; ++j) {
+                    info.function(toY(static_cast<float>(y + j)), {xs, static_cast<size_t>(w + 1)}, {values + j * SIDE, static_cast<size_t>(w + 1)});
+                }
+
+                for (int j = 0; j < h; ++j) {
+                    for (int i = 0; i < w; ++i) {
+                        const float* above = values + j * SIDE + i;
+                        const float* below = above + SIDE;
+                        if (!std::isfinite(above[0] + above[1] + below[0] + below[1])) {
+                            continue;
+                        }
+                        const float min = std::min(std::min(above[0], above[1]), std::min(below[0], below[1]));
+                        const float max = std::max(std::max(above[0], above[1]), std::max(below[0], below[1]));
+                        if (min <= 0.f && max > 0.f) {
+                            out.emplace_back(static_cast<float>(x + i), static_cast<float>(y + j));
+                        }
+                    }
+                }
+                return static_cast<uint64_t>(w + 1) * (h + 1);
+            }
+
+            uint64_t evaluations = 0;
+            if (info.bounds) {
+                // World y grows up the frame, so the cell's bottom row has the lower y there
+                const float top = toY(static_cast<float>(y));
+                const float bottom = toY(static_cast<float>(y + h));
+                const auto [lo, hi] = info.bounds(toX(static_cast<float>(x)), toX(static_cast<float>(x + w)), std::min(top, bottom), std::max(top, bottom));
+                evaluations = 1;
+                if (lo > 0.f || hi < 0.f) {
+                    return evaluations;
+                }
+            }
+            else {
+                // The same test as a pixel's: only a cell with samples on both sides of 0 can hold the curve
+                constexpr int SIDE = IMPLICIT_LATTICE;
+                float xs[SIDE];
+                float row[SIDE];
+                for (int i = 0; i < SIDE; ++i) {
+                    xs[i] = toX(static_cast<float>(x) + static_cast<float>(w * i) / (SIDE - 1));
+                }
+                bool positive = false;
+                bool negative = false;
+                for (int j = 0; j < SIDE; ++j) {
+                    info.function(toY(static_cast<float>(y) + static_cast<float>(h * j) / (SIDE - 1)), xs, row);
+                    for (const float value : row) {
+                        positive = positive || value > 0.f;
+                        negative = negative || value <= 0.f;
+                    }
+                }
+                evaluations = SIDE * SIDE;
+                if (!positive || !negative) {
+                    return evaluations;
+                }
+            }
+
+            const int left = (w + 1) / 2;
+            const int upper = (h + 1) / 2;
+            evaluations += SubdivideImplicit(info, viewport, x, y, left, upper, out);
+            if (w > left) {
+                evaluations += SubdivideImplicit(info, viewport, x + left, y, w - left, upper, out);
+            }
+            if (h > upper) {
+                evaluations += SubdivideImplicit(info, viewport, x, y + upper, left, h - upper, out);
+                if (w > left) {
+                    evaluations += SubdivideImplicit(info, viewport, x + left, y + upper, w - left, h - upper, out);
+                }
+            }
+            return evaluations;
+        }
+
+        // Leaves the pixels the curve crosses in points, tile by tile in row-major order
+        static void EvaluateImplicit(const SurfaceWrapper& surface, const ImplicitInfo& info, LayerSamples& samples, const Viewport& viewport,
+                                     const unsigned workers)
+        {
+            samples.points.clear();
+            samples.evaluations = 0;
+            if (!info.function || surface.width <= 0 || surface.height <= 0) {
+                return;
+            }
+            const int columns = (surface.width + IMPLICIT_TILE - 1) / IMPLICIT_TILE;
+            const int rows = (surface.height + IMPLICIT_TILE - 1) / IMPLICIT_TILE;
+
+            std::atomic<uint64_t> evaluations = 0;
+            samples.spans.resize(static_cast<size_t>(columns) * rows);
+            ParallelFor(workers, columns * rows, [&](const int tile) {
+                std::vector<Point>& out = samples.spans[tile];
+                out.clear();
+                const int x = tile % columns * IMPLICIT_TILE;
+                const int y = tile / columns * IMPLICIT_TILE;
+                evaluations += SubdivideImplicit(info, viewport, x, y, std::min(IMPLICIT_TILE, surface.width - x), std::min(IMPLICIT_TILE, surface.height - y), out);
+            });
+
+            for (const std::vector<Point>& span : samples.spans) {
+                samples.points.insert(samples.points.end(), span.begin(), span.end());
+            }
+            samples.evaluations = evaluations;
+        }
+
+        static void RasterizeImplicit(const SurfaceWrapper& surface, const ImplicitInfo& info, const LayerSamples& samples)
+        {
+            for (const Point point : samples.points) {
+                Plot(static_cast<int>(point.x), static_cast<int>(point.y), info.color, surface);
+            }
+        }
+
+        static void DrawImplicit(const SurfaceWrapper& surface, const ImplicitInfo& info)
+        {
+            LayerSamples& samples = DrawScratch();
+            EvaluateImplicit(LayerSurface(surface), info, samples, {}, 1);
+            RasterizeImplicit(Blended(surface, info.blend), info, samples);
+        }
+
+        // Columns per task when a series is reduced
+        static constexpr int SERIES_CHUNK = 64;
+
+        // Reduces the samples of every pixel column to the points of its M4 line: first, min, max and last. When
+        // there are barely more samples than columns they are kept as they are instead.
+        static void EvaluateSeries(const SurfaceWrapper& surface, const SeriesInfo& info, LayerSamples& samples, const Viewport& viewport,
+                                   const unsigned workers)
+        {
+            samples.points.clear();
+            if (!info.series || info.series->Size() == 0 || !(info.dx > 0.0)) {
+                return;
+            }
+            const Series& series = *info.series;
+            const std::span<const float> values = series.Values();
+            const auto size = static_cast<double>(values.size());
+            const int width = surface.width;
+
+            // First sample at or right of screen x, clamped to the series
+            auto sampleAt = [&](const double x) {
+                const double at = std::ceil((viewport.x0 + x * viewport.scale - info.x0) / info.dx);
+                return static_cast<size_t>(std::clamp(at, 0.0, size));
+            };
+            auto screenY = [&](const float value) {
+                return viewport.ScreenY(info.y0 + value * info.dy);
+            };
+            auto point = [&](const size_t i) {
+                return Point{viewport.ScreenX(info.x0 + static_cast<double>(i) * info.dx), screenY(values[i])};
+            };
+
+            // The samples just outside either edge keep the line running off screen instead of stopping at the edge
+            const size_t first = sampleAt(0.0);
+            const size_t last = sampleAt(width);
+            const size_t before = first > 0 ? first - 1 : first;
+            const size_t after = std::min(last + 1, values.size());
+
+            if (last - first <= static_cast<size_t>(width) * 2) {
+                for (size_t i = before; i < after; ++i) {
+                    samples.points.emplace_back(point(i));
+                }
+                return;
+            }
+
+            // Columns without samples are left NaN and dropped below
+            samples.spans.resize(1);
+            std::vector<Point>& columns = samples.spans[0];
+            columns.assign(static_cast<size_t>(width) * 4, {NAN, NAN});
+            ParallelFor(workers, (width + SERIES_CHUNK - 1) / SERIES_CHUNK, [&](const int chunk) {
+                const int end = std::min(width, (chunk + 1) * SERIES_CHUNK);
+                size_t a = sampleAt(chunk * SERIES_CHUNK);
+                for (int x = chunk * SERIES_CHUNK; x < end; ++x) {
+                    const size_t b = sampleAt(x + 1);
+                    if (b > a) {
+                        const Series::Range range = series.Find(a, b);
+                        const auto column = static_cast<float>(x);
+                        Point* out = columns.data() + static_cast<size_t>(x) * 4;
+                        out[0] = {column, screenY(values[a])};
+                        out[1] = {column, screenY(range.min)};
+                        out[2] = {column, screenY(range.max)};
+                        out[3] = {column, screenY(values[b - 1])};
+                    }
+                    a = b;
+                }
+            });
+
+            if (before < first) {
+                samples.points.emplace_back(point(before));
+            }
+            for (const Point column : columns) {
+                if (!std::isnan(column.x)) {
+                    samples.points.emplace_back(column);
+                }
+            }
+            if (last < after) {
+                samples.points.emplace_back(point(last));
+            }
+        }
+
+        static void DrawSeries(const SurfaceWrapper& surface, const SeriesInfo& info, const Viewport& viewport)
+        {
+            LayerSamples& samples = DrawScratch();
+            EvaluateSeries(LayerSurface(surface), info, samples, viewport, 1);
+            Polyline(samples.points, info.color, Blended(surface, info.blend), info.antialias);
+        }
+
+        static void DrawSeries(const SurfaceWrapper& surface, const SeriesInfo& info)
+        {
+            DrawSeries(surface, info, {});
+        }
+
+        // Reduces the columns a stream scrolled in since the last frame, plus the newest column which may have been
+        // partial, and keeps every other column from the ring of reduced columns
+        static void EvaluateStream(const SurfaceWrapper& surface, const StreamInfo& info, LayerSamples& samples, const Viewport& viewport,
+                                   const unsigned workers)
+        {
+            samples.points.clear();
+            samples.evaluations = 0;
+            if (!info.stream || info.samplesPerColumn < 1 || surface.width <= 0) {
+                return;
+            }
+            const int width = surface.width;
+            const uint64_t perColumn = static_cast<uint64_t>(info.samplesPerColumn);
+            const uint64_t count = info.stream->Count();
+            const uint64_t end = (count + perColumn - 1) / perColumn;
+            const uint64_t visible = end > static_cast<uint64_t>(width) ? end - width : 0;
+
+            const bool keep = samples.reusable && samples.width == width && samples.height == surface.height && samples.columnsEnd <= end;
+            const uint64_t first = keep ? std::max(visible, samples.columnsEnd > 0 ? samples.columnsEnd - 1 : 0) : visible;
+            samples.world.resize(static_cast<size_t>(width) * 4);
+
+            const auto columns = static_cast<int>(end - first);
+            samples.gathered.resize(static_cast<size_t>(columns) * perColumn);
+            info.stream->Read(first * perColumn, samples.gathered);
+
+            ParallelFor(workers, (columns + EVAL_CHUNK - 1) / EVAL_CHUNK, [&](const int chunk) {
+                const int last = std::min(columns, (chunk + 1) * EVAL_CHUNK);
+                for (int c = chunk * EVAL_CHUNK; c < last; ++c) {
+                    const float* in = samples.gathered.data() + static_cast<size_t>(c) * perColumn;
+                    float min = INFINITY;
+                    float max = -INFINITY;
+                    for (uint64_t i = 0; i < perColumn; ++i) {
+                        min = std::min(min, in[i]);
+                        max = std::max(max, in[i]);
+                    }
+                    // A partial column ends at its newest sample
+                    const uint64_t filled = std::min<uint64_t>(perColumn, count - (first + c) * perColumn);
+                    float* out = samples.world.data() + (first + c) % width * 4;
+                    out[0] = in[0];
+                    out[1] = min;
+                    out[2] = max;
+                    out[3] = in[filled - 1];
+                }
+            });
+            samples.evaluations = static_cast<uint64_t>(columns) * perColumn;
+
+            // Columns without any sample, before the stream's oldest one, are left out so the line starts there
+            auto screenY = [&](const float value) {
+                return viewport.ScreenY(info.y0 + value * info.dy);
+            };
+            for (uint64_t column = visible; column < end; ++column) {
+                const float* values = samples.world.data() + column % width * 4;
+                if (!(values[1] <= values[2])) {
+                    continue;
+                }
+                const auto x = static_cast<float>(width - static_cast<int>(end - column));
+                samples.points.emplace_back(x, screenY(values[0]));
+                if (perColumn > 1) {
+                    samples.points.emplace_back(x, screenY(values[1]));
+                    samples.points.emplace_back(x, screenY(values[2]));
+                    samples.points.emplace_back(x, screenY(values[3]));
+                }
+            }
+
+            samples.reusable = true;
+            samples.width = width;
+            samples.height = surface.height;
+            samples.appended = count;
+            samples.columnsEnd = end;
+        }
+
+        // False when cancelled, see SetCancelFlag
+        bool DrawAll(uint32_t* pixels, const int width, const int height)
+        {
+            const SurfaceWrapper surface = {pixels, width, height};
+            const auto start = std::chrono::steady_clock::now();
+            const int bandCount = BeginFrame(width * _supersampling, height * _supersampling);
+            PollStreams();
+            // A full draw leaves the samples in a state a progressive draw did not produce
+            _progress.active = false;
+
+            // Layers are evaluated for the caller's frame and drawn into the supersampled one, if any
+            const SurfaceWrapper frame = BeginSupersampling(surface);
+            if (_cacheEnabled) {
+                if (!DrawCached(surface, frame, bandCount)) {
+                    return false;
+                }
+            }
+            else {
+                // Evaluate every layer first, each one spread over all workers
+                for (size_t i = 0; i < _order.size(); ++i) {
+                    if (Cancelled()) {
+                        return false;
+                    }
+                    EvaluateLayer(i, surface, _workers);
+                }
+                RasterizeBands(frame, bandCount);
+                if (Cancelled()) {
+                    return false;
+                }
+            }
+            EndSupersampling(surface, frame);
+
+            EndFrame(bandCount, start);
+            return true;
+        }
+
+        // Draws what fits in budgetMs and returns true once the frame is exact. Surfaces are sampled at every 8th
+        // pixel first and refined to every 4th, every 2nd and finally every pixel over the following calls, each call
+        // resuming where the previous one stopped. The coarsest pass always completes, so every call shows a whole
+        // frame. The other layers are evaluated once and drawn over the surfaces on every call. Changing the size or
+        // any layer starts over.
+        bool DrawProgressive(uint32_t* pixels, const int width, const int height, const double budgetMs)
+        {
+            const SurfaceWrapper surface = {pixels, width, height};
+            const auto start = std::chrono::steady_clock::now();
+            const int bandCount = BeginFrame(width * _supersampling, height * _supersampling);
+            PollStreams();
+
+            if (!_progress.active || _progress.width != width || _progress.height != height || _progress.versions != _versions) {
+                StartProgress(surface);
+            }
+            if (Cancelled()) {
+                return false;
+            }
+
+            // The layers are drawn after refining, so the last frame's rasterization time is kept free for them
+            auto elapsed = [&] {
+                return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            };
+            while (_progress.pass < PROGRESSIVE_PASSES) {
+                RefineProgress(surface);
+                if (Cancelled()) {
+                    return false;
+                }
+                if (_progress.pass > 0 && elapsed() + _progress.rasterizeMs >= budgetMs) {
+                    break;
+                }
+            }
+
+            // Resampling is part of what the budget keeps free for rasterizing
+            const double rasterizeStart = elapsed();
+            const SurfaceWrapper frame = BeginSupersampling(surface);
+            if (_cacheEnabled) {
+                // Surfaces still being refined change on every call without a new version, so their records only
+                // ever serve the call that made them
+                CollectDirty(frame, true);
+                const bool replayed = ReplayCached(frame, bandCount);
+                for (size_t i = 0; i < _order.size(); ++i) {
+                    if (Refining(i)) {
+                        _caches[i].valid = false;
+                    }
+                }
+                if (!replayed) {
+                    return false;
+                }
+            }
+            else {
+                RasterizeBands(frame, bandCount);
+            }
+            if (Cancelled()) {
+                return false;
+            }
+            EndSupersampling(surface, frame);
+            _progress.rasterizeMs = elapsed() - rasterizeStart;
+            EndFrame(bandCount, start);
+            return _progress.pass == PROGRESSIVE_PASSES;
+        }
+
+        // Renders a frame too large to keep in memory one strip of stripRows rows at a time, every strip starting out as
+        // background and going to sink once finished. Memory stays bounded by the strip and the samples of the
+        // non-surface layers. Surfaces are evaluated strip by strip after a pre-pass that evaluates them once to find
+        // the range of the whole frame, which keeps their colors identical to DrawAll. Contour grids are sampled and
+        // traced strip by strip as well. False when cancelled or when the sink fails.
+        bool DrawStrips(const int width, const int height, const int stripRows, const StripSink& sink, const uint32_t background)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            const int rows = std::clamp(stripRows, 1, std::max(1, height));
+            const int bandCount = BeginFrame(width, rows);
+            PollStreams();
+            _progress.active = false;
+
+            std::vector<uint32_t>& strip = _strip;
+            strip.resize(static_cast<size_t>(width) * rows);
+            const SurfaceWrapper frame = {strip.data(), width, height};
+
+            for (size_t i = 0; i < _order.size(); ++i) {
+                // Contour levels are fixed, so their grids need nothing from the rest of the frame
+                if (_order[i].first == FuncType::CONTOUR) {
+                    continue;
+                }
+                if (_order[i].first != FuncType::SURFACE) {
+                    if (Cancelled()) {
+                        return false;
+                    }
+                    EvaluateLayer(i, frame, _workers);
+                    continue;
+                }
+                LayerSamples& samples = _samples[i];
+                float min = INFINITY;
+                float max = -INFINITY;
+                for (int top = 0; top < height; top += rows) {
+                    if (Cancelled()) {
+                        return false;
+                    }
+                    const auto range = EvaluateSurfaceRows(i, width, top, std::min(height, top + rows));
+                    min = std::min(min, range.first);
+                    max = std::max(max, range.second);
+                }
+                samples.min = min;
+                samples.max = max;
+                AssignColormap(_surfaces[_order[i].second], samples.colormap);
+            }
+
+            for (int top = 0; top < height; top += rows) {
+                const int bottom = std::min(height, top + rows);
+                Clear(strip.data(), strip.size(), background);
+                for (size_t i = 0; i < _order.size(); ++i) {
+                    if (_order[i].first == FuncType::SURFACE) {
+                        EvaluateSurfaceRows(i, width, top, bottom);
+                    }
+                    else if (_order[i].first == FuncType::CONTOUR) {
+                        EvaluateContourRows(i, frame, top, bottom);
+                    }
+                }
+
+                SurfaceWrapper target = frame;
+                target.top = top;
+                target.bottom = bottom;
+                target.offset = frame.Index(0, top);
+                RasterizeBands(target, bandCount);
+                if (Cancelled() || !sink(strip.data(), top, bottom - top)) {
+                    return false;
+                }
+            }
+
+            // The surfaces' samples only hold the last strip now
+            for (size_t i = 0; i < _order.size(); ++i) {
+                if (_order[i].first == FuncType::SURFACE) {
+                    _samples[i].reusable = false;
+                }
+            }
+            EndFrame(bandCount, start);
+            return true;
+        }
+
+    private:
+        bool Cancelled() const {
+            return _cancel && _cancel->load(std::memory_order_relaxed);
+        }
+
+        BlendMode LayerBlend(const size_t layer) const {
+            const auto pair = _order[layer];
+            switch (pair.first) {
+                case FuncType::FUNCTION:
+                    return _functions[pair.second].blend;
+                case FuncType::SURFACE:
+                case FuncType::CONTOUR:
+                    return _surfaces[pair.second].blend;
+                case FuncType::EQUATION:
+                    return _equations[pair.second].blend;
+                case FuncType::PARAMSURFACE:
+                    return _parametricSurfaces[pair.second].blend;
+                case FuncType::SERIES:
+                    return _series[pair.second].blend;
+                case FuncType::STREAM:
+                    return _streams[pair.second].blend;
+                case FuncType::IMPLICIT:
+                    return _implicits[pair.second].blend;
+                default:
+                    return BlendMode::REPLACE;
+            }
+        }
+
+        // Whether the layer depends on the viewport
+        bool IsWorld(const size_t layer) const {
+            const auto pair = _order[layer];
+            switch (pair.first) {
+                case FuncType::FUNCTION:
+                    return static_cast<bool>(_functions[pair.second].world);
+                case FuncType::SURFACE:
+                case FuncType::CONTOUR:
+                    return static_cast<bool>(_surfaces[pair.second].world);
+                case FuncType::EQUATION:
+                    return _equations[pair.second].world;
+                case FuncType::PARAMSURFACE:
+                    return _parametricSurfaces[pair.second].world;
+                case FuncType::IMPLICIT:
+                    return _implicits[pair.second].world;
+                case FuncType::SERIES:
+                case FuncType::STREAM:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        // Prepares the shared buffers and stats of a frame, returns its number of row bands
+        int BeginFrame(const int width, const int height)
+        {
+            // Row bands are only worth their bookkeeping with more than one worker
+            const int bandCount = _workers <= 1 ? 1 : std::max(1, std::min(height, static_cast<int>(_workers) * 4));
+
+            if (_depth.size() != static_cast<size_t>(width) * height) {
+                _depth.assign(static_cast<size_t>(width) * height, -INFINITY);
+            }
+            _touched.resize(bandCount);
+            _samples.resize(_order.size());
+
+            if (_statsEnabled) {
+                _stats.layers.assign(_order.size(), {});
+                _stats.resampleMs = 0.0;
+                _bandStats.resize(bandCount);
+                for (std::vector<LayerStats>& band : _bandStats) {
+                    band.assign(_order.size(), {});
+                }
+            }
+            return bandCount;
+        }
+
+        // The frame DrawAll and DrawProgressive draw into: surface itself, or the supersampled frame holding its pixels
+        // scaled up
+        SurfaceWrapper BeginSupersampling(const SurfaceWrapper& surface)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            const SurfaceWrapper frame = SupersampledFrame(surface, _supersampling, _supersampled, _workers);
+            if (_statsEnabled) {
+                _stats.resampleMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            }
+            return frame;
+        }
+
+        void EndSupersampling(const SurfaceWrapper& surface, const SurfaceWrapper& frame)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            ResolveFrame(surface, frame, _filter, _downsampled, _workers);
+            if (_statsEnabled) {
+                _stats.resampleMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            }
+        }
+
+        // Streams that received samples since they were last drawn count as changed
+        void PollStreams()
+        {
+            for (size_t i = 0; i < _order.size(); ++i) {
+                if (_order[i].first != FuncType::STREAM) {
+                    continue;
+                }
+                const Stream* stream = _streams[_order[i].second].stream;
+                if (stream && stream->Count() != _samples[i].appended) {
+                    ++_versions[i];
+                }
+            }
+        }
+
+        static SurfaceWrapper BandSurface(const SurfaceWrapper& surface, const int band, const int bandCount)
+        {
+            // Splits the rows the surface may write, which are all of them except while rendering strips
+            const int top = std::max(surface.top, 0);
+            const int bottom = std::min(surface.bottom, surface.height);
+            const int bandHeight = (bottom - top + bandCount - 1) / bandCount;
+            SurfaceWrapper bandSurface = surface;
+            bandSurface.top = top + band * bandHeight;
+            bandSurface.bottom = std::min(bottom, bandSurface.top + bandHeight);
+            return bandSurface;
+        }
+
+        // Rasterizes row bands independently. A band only writes its own rows and draws the layers front to back,
+        // so every pixel receives its writes in the same order as on the serial path.
+        void RasterizeBands(const SurfaceWrapper& surface, const int bandCount)
+        {
+            ParallelFor(_workers, bandCount, [&](const int band) {
+                const SurfaceWrapper target = BandSurface(surface, band, bandCount);
+                for (size_t i = 0; i < _order.size() && !Cancelled(); ++i) {
+                    RasterizeLayer(i, Blended(target, LayerBlend(i)), _touched[band], band);
+                }
+            });
+        }
+
+        void EndFrame(const int bandCount, const std::chrono::steady_clock::time_point start)
+        {
+            if (!_statsEnabled) {
+                return;
+            }
+            for (int band = 0; band < bandCount; ++band) {
+                for (size_t i = 0; i < _order.size(); ++i) {
+                    const LayerStats& from = _bandStats[band][i];
+                    LayerStats& to = _stats.layers[i];
+                    to.rasterizeMs += from.rasterizeMs;
+                    to.pixelsWritten += from.pixelsWritten;
+                    to.pixelsRejected += from.pixelsRejected;
+                    to.linesRejected += from.linesRejected;
+                }
+            }
+            ++_stats.frame;
+            _stats.totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            if (_trace) {
+                DumpStats(*_trace);
+            }
+        }
+
+        // Clears the surfaces for a new round of refinement and evaluates every other layer that changed in full
+        void StartProgress(const SurfaceWrapper& surface)
+        {
+            const bool resized = !_progress.active || _progress.width != surface.width || _progress.height != surface.height;
+            for (size_t i = 0; i < _order.size(); ++i) {
+                if (_order[i].first == FuncType::SURFACE) {
+                    continue;
+                }
+                if (resized || i >= _progress.versions.size() || _progress.versions[i] != _versions[i]) {
+                    // Half evaluated layers must not be taken as current by the next call
+                    if (Cancelled()) {
+                        _progress.active = false;
+                        return;
+                    }
+                    EvaluateLayer(i, surface, _workers);
+                }
+            }
+
+            _progress.active = true;
+            _progress.width = surface.width;
+            _progress.height = surface.height;
+            _progress.versions = _versions;
+            _progress.pass = 0;
+            _progress.layer = 0;
+            _progress.row = 0;
+
+            _progressXs.resize(surface.width);
+            for (int x = 0; x < surface.width; ++x) {
+                _progressXs[x] = _viewport.WorldX(x);
+            }
+
+            for (size_t i = 0; i < _order.size(); ++i) {
+                if (_order[i].first != FuncType::SURFACE) {
+                    continue;
+                }
+                LayerSamples& samples = _samples[i];
+                // A surface that was complete and has not been invalidated since keeps its samples, only its colours
+                // may have changed. A world-space one only evaluates what a new view does not share with the old
+                // one. Either is exact right away and skipped by the refinement.
+                if (Reusable(surface, samples)) {
+                    if (IsWorld(i) && samples.viewport != _viewport) {
+                        EvaluateLayer(i, surface, _workers);
+                    }
+                    else {
+                        AssignColormap(_surfaces[_order[i].second], samples.colormap);
+                    }
+                    continue;
+                }
+                samples.reusable = false;
+                samples.memoized = false;
+                samples.values.assign(static_cast<size_t>(surface.width) * surface.height, 0.f);
+                samples.min = INFINITY;
+                samples.max = -INFINITY;
+                AssignColormap(_surfaces[_order[i].second], samples.colormap);
+            }
+
+            // With every surface kept the first frame is already exact
+            bool refining = false;
+            for (size_t i = 0; i < _order.size(); ++i) {
+                refining = refining || (_order[i].first == FuncType::SURFACE && !_samples[i].reusable);
+            }
+            if (!refining) {
+                _progress.pass = PROGRESSIVE_PASSES;
+            }
+        }
+
+        // Refines the next few rows of the current pass and surface, moving on to the next surface and pass as they
+        // complete. Passes 0 and 1 sample every 8th and 4th pixel of every 8th and 4th row and fill the block
+        // below and right of each sample with it. Pass 2 evaluates the even rows in full and copies each into the
+        // odd row below, which pass 3 then evaluates.
+        void RefineProgress(const SurfaceWrapper& surface)
+        {
+            while (_progress.layer < _order.size() && (_order[_progress.layer].first != FuncType::SURFACE || _samples[_progress.layer].reusable)) {
+                ++_progress.layer;
+            }
+            if (_progress.layer == _order.size()) {
+                ++_progress.pass;
+                _progress.layer = 0;
+                _progress.row = 0;
+                if (_progress.pass == PROGRESSIVE_PASSES) {
+                    MarkRefined(surface);
+                }
+                return;
+            }
+
+            const int pass = _progress.pass;
+            const int stride = pass < 2 ? 8 >> pass : 2;
+            const int first = pass == 3 ? 1 : 0;
+            const int rows = std::max(0, (surface.height - first + stride - 1) / stride);
+            const int batch = std::min(rows - _progress.row, static_cast<int>(std::max(1u, _workers)) * 4);
+
+            const SurfaceInfo& info = _surfaces[_order[_progress.layer].second];
+            LayerSamples& samples = _samples[_progress.layer];
+            _progressRanges.resize(std::max(0, batch));
+
+            auto evaluate = [&](const int y, const int x0, const std::span<float> out) {
+                if (info.world) {
+                    info.world(_viewport.WorldY(y), {_progressXs.data() + x0, out.size()}, out);
+                }
+                else {
+                    EvaluateBatch(info, y, x0, out);
+                }
+            };
+
+            ParallelFor(_workers, batch, [&](const int i) {
+                const int y = first + (_progress.row + i) * stride;
+                const int width = surface.width;
+                float* values = samples.values.data();
+                float min = INFINITY;
+                float max = -INFINITY;
+
+                if (pass < 2) {
+                    const int height = std::min(stride, surface.height - y);
+                    for (int x = 0; x < width; x += stride) {
+                        // The first pass already has every 8th sample of every 8th row
+                        if (pass == 1 && x % 8 == 0 && y % 8 == 0) {
+                            continue;
+                        }
+                        float value;
+                        evaluate(y, x, {&value, 1});
+                        min = std::min(min, value);
+                        max = std::max(max, value);
+
+                        const int columns = std::min(stride, width - x);
+                        for (int row = 0; row < height; ++row) {
+                            std::fill_n(values + static_cast<size_t>(y + row) * width + x, columns, value);
+                        }
+                    }
+                }
+                else {
+                    float* row = values + static_cast<size_t>(y) * width;
+                    evaluate(y, 0, {row, static_cast<size_t>(width)});
+                    for (int x = 0; x < width; ++x) {
+                        min = std::min(min, row[x]);
+                        max = std::max(max, row[x]);
+                    }
+                    if (pass == 2 && y + 1 < surface.height) {
+                        std::copy(row, row + width, row + width);
+                    }
+                }
+                _progressRanges[i] = {min, max};
+            });
+
+            for (const auto& [min, max] : _progressRanges) {
+                samples.min = std::min(samples.min, min);
+                samples.max = std::max(samples.max, max);
+            }
+
+            _progress.row += std::max(0, batch);
+            if (_progress.row >= rows) {
+                ++_progress.layer;
+                _progress.row = 0;
+            }
+        }
+
+        // Evaluates rows [top, bottom) of a surface layer into its values, row top first, and returns their range
+        std::pair<float, float> EvaluateSurfaceRows(const size_t layer, const int width, const int top, const int bottom)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            const SurfaceInfo& info = _surfaces[_order[layer].second];
+            LayerSamples& samples = _samples[layer];
+            // Only a strip of the samples is held from here on
+            samples.memoized = false;
+            samples.values.resize(static_cast<size_t>(width) * (bottom - top));
+            if (info.world) {
+                samples.xs.resize(width);
+                for (int x = 0; x < width; ++x) {
+                    samples.xs[x] = _viewport.WorldX(x);
+                }
+            }
+
+            std::vector<std::pair<float, float>>& rowRanges = samples.ranges;
+            rowRanges.resize(bottom - top);
+            ParallelFor(_workers, bottom - top, [&](const int i) {
+                const int y = top + i;
+                float* row = samples.values.data() + static_cast<size_t>(i) * width;
+                if (info.world) {
+                    info.world(_viewport.WorldY(y), samples.xs, {row, static_cast<size_t>(width)});
+                }
+                else {
+                    EvaluateBatch(info, y, 0, {row, static_cast<size_t>(width)});
+                }
+
+                float min = INFINITY;
+                float max = -INFINITY;
+                for (int x = 0; x < width; ++x) {
+                    min = std::min(min, row[x]);
+                    max = std::max(max, row[x]);
+                }
+                rowRanges[i] = {min, max};
+            });
+
+            std::pair<float, float> range = {INFINITY, -INFINITY};
+            for (const auto& [min, max] : rowRanges) {
+                range.first = std::min(range.first, min);
+                range.second = std::max(range.second, max);
+            }
+
+            if (_statsEnabled) {
+                LayerStats& stats = _stats.layers[layer];
+                stats.evaluateMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                stats.evaluations += static_cast<uint64_t>(width) * (bottom - top);
+            }
+            return range;
+        }
+
+        // Traces the contours of a contour layer that can reach rows [top, bottom) of the frame
+        void EvaluateContourRows(const size_t layer, const SurfaceWrapper& frame, const int top, const int bottom)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            LayerSamples& samples = _samples[layer];
+            // Only the grid of a strip is held from here on
+            samples.memoized = false;
+            EvaluateContours(frame, _surfaces[_order[layer].second], samples, _viewport, _workers, top, bottom);
+
+            if (_statsEnabled) {
+                LayerStats& stats = _stats.layers[layer];
+                stats.evaluateMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                stats.evaluations += samples.values.size();
+            }
+        }
+
+        // Fully refined surfaces are exact, world-space ones for the current view so the next view can start from them
+        void MarkRefined(const SurfaceWrapper& surface)
+        {
+            for (size_t i = 0; i < _order.size(); ++i) {
+                if (_order[i].first == FuncType::SURFACE) {
+                    LayerSamples& samples = _samples[i];
+                    samples.reusable = true;
+                    samples.viewport = _viewport;
+                    samples.width = surface.width;
+                    samples.height = surface.height;
+                }
+            }
+        }
+
+        void EvaluateLayer(const size_t layer, const SurfaceWrapper& surface, const unsigned workers)
+        {
+            if (_statsEnabled) {
+                const auto start = std::chrono::steady_clock::now();
+                const bool recalled = !EvaluateLayerUntimed(layer, surface, workers);
+
+                const LayerSamples& samples = _samples[layer];
+                LayerStats& stats = _stats.layers[layer];
+                stats.evaluateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                stats.recalled = recalled;
+                if (recalled) {
+                    stats.evaluations = 0;
+                    return;
+                }
+                if (_order[layer].first == FuncType::STREAM || _order[layer].first == FuncType::IMPLICIT
+                    || (IsWorld(layer) && (_order[layer].first == FuncType::FUNCTION || _order[layer].first == FuncType::SURFACE))) {
+                    // Samples shared with the previous view or frame were not evaluated again
+                    stats.evaluations = samples.evaluations;
+                    return;
+                }
+                switch (_order[layer].first) {
+                    case FuncType::FUNCTION:
+                        // Adaptive functions keep their samples as points instead
+                        stats.evaluations = samples.values.size() + samples.points.size();
+                        break;
+                    case FuncType::EQUATION:
+                    case FuncType::SERIES:
+                        stats.evaluations = samples.points.size();
                         break;
                     case FuncType::PARAMSURFACE:
-                        DrawParametricSurface(surface, _parametricSurfaces[pair.second]);
+                        stats.evaluations = samples.samples.size() + samples.vertices.size();
                         break;
-                    default: ;
+                    default:
+                        stats.evaluations = samples.values.size();
+                }
+                return;
+            }
+            EvaluateLayerUntimed(layer, surface, workers);
+        }
+
+        // False when the evaluation cache still held the layer's samples and nothing was evaluated
+        bool EvaluateLayerUntimed(const size_t layer, const SurfaceWrapper& surface, const unsigned workers)
+        {
+            const auto pair = _order[layer];
+            const bool memoized = Memoized(layer);
+            const EvaluationKey key = memoized ? KeyOf(layer, surface) : EvaluationKey{};
+            if (memoized && Recall(layer, key)) {
+                // The colours may have changed since, mapping the samples again is all a style update needs
+                if (pair.first == FuncType::SURFACE) {
+                    AssignColormap(_surfaces[pair.second], _samples[layer].colormap);
+                }
+                else if (pair.first == FuncType::PARAMSURFACE) {
+                    AssignColormap(_parametricSurfaces[pair.second], _samples[layer].colormap);
+                }
+                return false;
+            }
+
+            switch (pair.first) {
+                case FuncType::FUNCTION: {
+                    const FunctionInfo& info = _functions[pair.second];
+                    if (info.world) {
+                        EvaluateWorldFunction(surface, info, _samples[layer], _viewport, workers);
+                    }
+                    else {
+                        EvaluateFunction(surface, info, _samples[layer], workers);
+                    }
+                    break;
+                }
+                case FuncType::SURFACE: {
+                    const SurfaceInfo& info = _surfaces[pair.second];
+                    if (info.world) {
+                        EvaluateWorldSurface(surface, info, _samples[layer], _viewport, workers);
+                    }
+                    else {
+                        EvaluateSurface(surface, info, _samples[layer], workers);
+                    }
+                    break;
+                }
+                case FuncType::EQUATION: {
+                    const EquationInfo& info = _equations[pair.second];
+                    EvaluateEquation(info, _samples[layer], _viewport, workers);
+                    break;
+                }
+                case FuncType::PARAMSURFACE: {
+                    const ParametricSurfaceInfo& info = _parametricSurfaces[pair.second];
+                    EvaluateParametricSurface(info, _samples[layer], _viewport, workers);
+                    break;
+                }
+                case FuncType::SERIES:
+                    EvaluateSeries(surface, _series[pair.second], _samples[layer], _viewport, workers);
+                    break;
+                case FuncType::STREAM:
+                    EvaluateStream(surface, _streams[pair.second], _samples[layer], _viewport, workers);
+                    break;
+                case FuncType::CONTOUR:
+                    EvaluateContours(surface, _surfaces[pair.second], _samples[layer], _viewport, workers);
+                    break;
+                case FuncType::IMPLICIT:
+                    EvaluateImplicit(surface, _implicits[pair.second], _samples[layer], _viewport, workers);
+                    break;
+                default: ;
+            }
+            _samples[layer].memoized = memoized;
+            _samples[layer].key = key;
+            return true;
+        }
+
+        // Whether the evaluation cache keeps the layer's samples. Other layers are cheap to evaluate or, like
+        // streams, change without a new version.
+        bool Memoized(const size_t layer) const {
+            if (_memoLimit == 0) {
+                return false;
+            }
+            switch (_order[layer].first) {
+                case FuncType::SURFACE:
+                case FuncType::CONTOUR:
+                case FuncType::EQUATION:
+                case FuncType::PARAMSURFACE:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        EvaluationKey KeyOf(const size_t layer, const SurfaceWrapper& surface) const {
+            EvaluationKey key;
+            key.version = _parameterVersions[layer];
+            // Equations and parametric surfaces are sampled by their own parameters whatever the frame size
+            if (_order[layer].first == FuncType::SURFACE || _order[layer].first == FuncType::CONTOUR) {
+                key.width = surface.width;
+                key.height = surface.height;
+            }
+            if (IsWorld(layer)) {
+                key.viewport = _viewport;
+            }
+            return key;
+        }
+
+        // True when the layer's samples at key are its current ones or were kept, in which case they are current
+        // now. Otherwise the current samples are kept for later, as long as they fit, before they are replaced.
+        bool Recall(const size_t layer, const EvaluationKey& key)
+        {
+            LayerSamples& samples = _samples[layer];
+            if (samples.memoized && samples.key == key) {
+                ++_memoStats.hits;
+                return true;
+            }
+
+            const bool current = samples.memoized && samples.key.version == key.version;
+            const auto entry = std::find_if(_memo.begin(), _memo.end(), [&](const EvaluationEntry& kept) {
+                return kept.layer == layer && kept.key == key;
+            });
+            if (entry == _memo.end()) {
+                ++_memoStats.misses;
+                const size_t bytes = SamplesBytes(samples.values, samples.points, samples.samples, samples.triangles);
+                if (current && bytes <= _memoLimit) {
+                    // Copied rather than swapped, a world-space surface shares the current samples with the new view
+                    EvaluationEntry& kept = FreeEntry(layer, bytes);
+                    kept.layer = layer;
+                    kept.key = samples.key;
+                    kept.used = ++_memoClock;
+                    kept.values.assign(samples.values.begin(), samples.values.end());
+                    kept.points.assign(samples.points.begin(), samples.points.end());
+                    kept.samples.assign(samples.samples.begin(), samples.samples.end());
+                    kept.triangles.assign(samples.triangles.begin(), samples.triangles.end());
+                    kept.min = samples.min;
+                    kept.max = samples.max;
+                    Evict();
+                }
+                return false;
+            }
+
+            // The samples trade places with the entry, which then holds the ones that were current
+            ++_memoStats.hits;
+            samples.values.swap(entry->values);
+            samples.points.swap(entry->points);
+            samples.samples.swap(entry->samples);
+            samples.triangles.swap(entry->triangles);
+            std::swap(samples.min, entry->min);
+            std::swap(samples.max, entry->max);
+            if (current) {
+                entry->key = samples.key;
+                entry->used = ++_memoClock;
+            }
+            else {
+                _memo.erase(entry);
+            }
+            samples.memoized = true;
+            samples.key = key;
+
+            // The surface is complete again, a world-space one shares samples with the next view from these
+            samples.reusable = _order[layer].first == FuncType::SURFACE;
+            samples.viewport = key.viewport;
+            samples.width = key.width;
+            samples.height = key.height;
+            Evict();
+            return true;
+        }
+
+        static size_t SamplesBytes(const std::vector<float>& values, const std::vector<Point>& points, const std::vector<Sample>& samples,
+                                   const std::vector<Triangle>& triangles) {
+            return values.size() * sizeof(float) + points.size() * sizeof(Point) + samples.size() * sizeof(Sample)
+                + triangles.size() * sizeof(Triangle);
+        }
+
+        size_t MemoBytes() const {
+            size_t bytes = 0;
+            for (const EvaluationEntry& entry : _memo) {
+                bytes += SamplesBytes(entry.values, entry.points, entry.samples, entry.triangles);
+            }
+            return bytes;
+        }
+
+        // Entry to keep bytes of the layer's samples in. When they would not fit next to the others, an entry that
+        // would be evicted is handed out instead, so a full cache reuses its storage rather than allocating anew. The
+        // least recently used one of the same layer goes first, its samples are of the same kind and mostly size.
+        EvaluationEntry& FreeEntry(const size_t layer, const size_t bytes)
+        {
+            if (_memo.empty() || MemoBytes() + bytes <= _memoLimit) {
+                return _memo.emplace_back();
+            }
+            auto oldest = _memo.end();
+            for (auto entry = _memo.begin(); entry != _memo.end(); ++entry) {
+                if (entry->layer == layer && (oldest == _memo.end() || entry->used < oldest->used)) {
+                    oldest = entry;
+                }
+            }
+            if (oldest == _memo.end()) {
+                oldest = std::min_element(_memo.begin(), _memo.end(), [](const EvaluationEntry& a, const EvaluationEntry& b) {
+                    return a.used < b.used;
+                });
+            }
+            ++_memoStats.evictions;
+            return *oldest;
+        }
+
+        // Drops the least recently used entries until the rest fit the limit
+        void Evict()
+        {
+            size_t bytes = MemoBytes();
+            while (bytes > _memoLimit) {
+                const auto oldest = std::min_element(_memo.begin(), _memo.end(), [](const EvaluationEntry& a, const EvaluationEntry& b) {
+                    return a.used < b.used;
+                });
+                bytes -= SamplesBytes(oldest->values, oldest->points, oldest->samples, oldest->triangles);
+                _memo.erase(oldest);
+                ++_memoStats.evictions;
+            }
+            _memoStats.entries = _memo.size();
+            _memoStats.bytes = bytes;
+        }
+
+        void RasterizeLayer(const size_t layer, const SurfaceWrapper& surface, std::vector<ptrdiff_t>& touched, const int band)
+        {
+            if (_statsEnabled) {
+                LayerStats& stats = _bandStats[band][layer];
+                SurfaceWrapper counted = surface;
+                counted.stats = &stats;
+
+                const auto start = std::chrono::steady_clock::now();
+                RasterizeLayerUntimed(layer, counted, touched);
+                stats.rasterizeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                return;
+            }
+            RasterizeLayerUntimed(layer, surface, touched);
+        }
+
+        void RasterizeLayerUntimed(const size_t layer, const SurfaceWrapper& surface, std::vector<ptrdiff_t>& touched)
+        {
+            const auto pair = _order[layer];
+            switch (pair.first) {
+                case FuncType::FUNCTION:
+                    RasterizeFunction(surface, _functions[pair.second], _samples[layer]);
+                    break;
+                case FuncType::SURFACE:
+                    RasterizeSurface(surface, _surfaces[pair.second], _samples[layer]);
+                    break;
+                case FuncType::EQUATION:
+                    RasterizeEquation(surface, _equations[pair.second], _samples[layer]);
+                    break;
+                case FuncType::PARAMSURFACE:
+                    RasterizeParametricSurface(surface, _parametricSurfaces[pair.second], _samples[layer], _depth, touched);
+                    break;
+                case FuncType::SERIES:
+                    Polyline(_samples[layer].points, _series[pair.second].color, surface, _series[pair.second].antialias);
+                    break;
+                case FuncType::STREAM:
+                    Polyline(_samples[layer].points, _streams[pair.second].color, surface, _streams[pair.second].antialias);
+                    break;
+                case FuncType::CONTOUR:
+                    RasterizeContours(surface, _surfaces[pair.second], _samples[layer]);
+                    break;
+                case FuncType::IMPLICIT:
+                    RasterizeImplicit(surface, _implicits[pair.second], _samples[layer]);
+                    break;
+                default: ;
+            }
+        }
+
+        // Whether DrawProgressive has yet to refine the layer, which is then a surface whose samples are incomplete
+        bool Refining(const size_t layer) const {
+            return _progress.active && _progress.pass < PROGRESSIVE_PASSES && _order[layer].first == FuncType::SURFACE
+                && !_samples[layer].reusable;
+        }
+
+        // Puts the layers whose cache is missing, out of date or of another frame size into _dirty, in order, and
+        // with progressive the surfaces still being refined too
+        void CollectDirty(const SurfaceWrapper& frame, const bool progressive)
+        {
+            _caches.resize(_order.size());
+            _dirty.clear();
+            for (size_t i = 0; i < _order.size(); ++i) {
+                const LayerCache& cache = _caches[i];
+                if (!cache.valid || cache.version != _versions[i] || cache.width != frame.width || cache.height != frame.height
+                    || (progressive && Refining(i))) {
+                    _dirty.emplace_back(i);
+                }
+            }
+        }
+
+        // Evaluates for surface and draws into frame, which is surface itself unless supersampling. False when cancelled,
+        // in which case no cache is marked current.
+        bool DrawCached(const SurfaceWrapper& surface, const SurfaceWrapper& frame, const int bandCount)
+        {
+            CollectDirty(frame, false);
+            for (const size_t i : _dirty) {
+                if (Cancelled()) {
+                    return false;
+                }
+                EvaluateLayer(i, surface, _workers);
+            }
+            return ReplayCached(frame, bandCount);
+        }
+
+        // Rasterizes the layers in _dirty, whose samples are current, into their caches, then replays every layer's
+        // cache into frame. False when cancelled, in which case no cache is marked current.
+        bool ReplayCached(const SurfaceWrapper& frame, const int bandCount)
+        {
+            const size_t frameSize = static_cast<size_t>(frame.width) * frame.height;
+            if (!_dirty.empty()) {
+                for (const size_t i : _dirty) {
+                    LayerCache& cache = _caches[i];
+                    if (_order[i].first == FuncType::SURFACE) {
+                        cache.pixels.resize(frameSize);
+                    }
+                    cache.writes.resize(bandCount);
+                }
+                _canvas.resize(frameSize);
+
+                // Surfaces rasterize straight into their cached frame, everything else into the scratch canvas while
+                // its writes are recorded
+                ParallelFor(_workers, bandCount, [&](const int band) {
+                    for (const size_t i : _dirty) {
+                        if (Cancelled()) {
+                            return;
+                        }
+                        LayerCache& cache = _caches[i];
+                        SurfaceWrapper target = BandSurface(frame, band, bandCount);
+                        cache.writes[band].clear();
+
+                        // A surface's own frame holds its colours, which are blended in as the frame is replayed
+                        if (_order[i].first == FuncType::SURFACE) {
+                            target.pixels = cache.pixels.data();
+                        }
+                        else {
+                            target.pixels = _canvas.data();
+                            target.record = &cache.writes[band];
+                            target.blend = LayerBlend(i);
+                        }
+                        RasterizeLayer(i, target, _touched[band], band);
+                    }
+                });
+                if (Cancelled()) {
+                    return false;
+                }
+
+                for (const size_t i : _dirty) {
+                    LayerCache& cache = _caches[i];
+                    cache.valid = true;
+                    cache.version = _versions[i];
+                    cache.width = frame.width;
+                    cache.height = frame.height;
+                }
+            }
+
+            if (_statsEnabled) {
+                for (size_t i = 0; i < _order.size(); ++i) {
+                    _stats.layers[i].cached = std::find(_dirty.begin(), _dirty.end(), i) == _dirty.end();
+                }
+            }
+
+            // Replaying the layers front to back repeats every write in its original order
+            for (size_t i = 0; i < _order.size(); ++i) {
+                const LayerCache& cache = _caches[i];
+                if (_order[i].first == FuncType::SURFACE) {
+                    BlendRow(frame.pixels, cache.pixels.data(), cache.pixels.size(), LayerBlend(i));
+                    continue;
+                }
+                for (const std::vector<Write>& writes : cache.writes) {
+                    for (const Write write : writes) {
+                        frame.pixels[write.index] = Compose(write.blend, frame.pixels[write.index], write.color, write.coverage);
+                    }
                 }
             }
+            return true;
         }
     };
 }
\ No newline at end of file
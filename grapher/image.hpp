@@ -0,0 +1,414 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace GR
+{
+    enum class ImageFormat
+    {
+        BMP,
+        PPM,
+        PNG
+    };
+
+    enum class VideoFormat
+    {
+        // YUV4MPEG2 with 4:2:0 full-range BT.601 chroma, flagged with XCOLORRANGE=FULL so ffmpeg and players do not
+        // take it for limited range
+        Y4M,
+        // R, G, B, A bytes per pixel with no header, for piping into an encoder that is told the size
+        RGBA
+    };
+
+    // Writes 0xAARRGGBB framebuffer rows to a stream as they are produced, top row first, so a caller never needs
+    // the whole image in memory. The header goes out on construction and the image is complete once `height` rows
+    // have been written. An image the format cannot describe writes nothing and is never complete, see Fits.
+    class ImageWriter
+    {
+    public:
+        ImageWriter(std::ostream& out, const ImageFormat format, const int width, const int height)
+            : _out(out), _format(format), _width(width), _height(height), _fits(Fits(format, width, height))
+        {
+            if (!_fits) {
+                return;
+            }
+            switch (_format) {
+                case ImageFormat::BMP:
+                    WriteBmpHeader();
+                    break;
+                case ImageFormat::PPM:
+                    _out << "P6\n" << _width << " " << _height << "\n255\n";
+                    break;
+                case ImageFormat::PNG:
+                    WritePngHeader();
+                    break;
+            }
+        }
+
+        // Appends `rows` rows of `width` pixels. Rows past the image height are ignored.
+        void WriteRows(const uint32_t* pixels, int rows)
+        {
+            rows = std::min(rows, _height - _written);
+            if (rows <= 0 || !_fits) {
+                return;
+            }
+
+            switch (_format) {
+                case ImageFormat::BMP:
+                    // 32-bit BI_RGB stores B, G, R, X per pixel, which is the framebuffer's little-endian layout
+                    _row.resize(static_cast<size_t>(_width) * 4);
+                    for (int y = 0; y < rows; ++y) {
+                        const uint32_t* src = pixels + static_cast<size_t>(y) * _width;
+                        for (int x = 0; x < _width; ++x) {
+                            _row[x * 4 + 0] = static_cast<char>(src[x] & 0xff);
+                            _row[x * 4 + 1] = static_cast<char>(src[x] >> 8 & 0xff);
+                            _row[x * 4 + 2] = static_cast<char>(src[x] >> 16 & 0xff);
+                            _row[x * 4 + 3] = static_cast<char>(src[x] >> 24 & 0xff);
+                        }
+                        _out.write(_row.data(), static_cast<std::streamsize>(_row.size()));
+                    }
+                    break;
+                case ImageFormat::PPM:
+                    _row.resize(static_cast<size_t>(_width) * 3);
+                    for (int y = 0; y < rows; ++y) {
+                        const uint32_t* src = pixels + static_cast<size_t>(y) * _width;
+                        PackRgb(src, _row.data());
+                        _out.write(_row.data(), static_cast<std::streamsize>(_row.size()));
+                    }
+                    break;
+                case ImageFormat::PNG:
+                    WritePngRows(pixels, rows);
+                    break;
+            }
+            _written += rows;
+        }
+
+        bool Complete() const {
+            return _fits && _written == _height && _out.good();
+        }
+
+        // BMP stores its file size in 32 bits, so an image over 4 GiB only fits in PPM or PNG
+        static bool Fits(const ImageFormat format, const int width, const int height)
+        {
+            if (format != ImageFormat::BMP) {
+                return true;
+            }
+            return BMP_HEADER_SIZE + static_cast<uint64_t>(width) * static_cast<uint64_t>(height) * 4 <= UINT32_MAX;
+        }
+
+        static bool FormatFromExtension(const std::string_view path, ImageFormat& format)
+        {
+            const size_t dot = path.rfind('.');
+            if (dot == std::string_view::npos) {
+                return false;
+            }
+            std::string extension;
+            for (const char c : path.substr(dot + 1)) {
+                extension += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+            if (extension == "bmp") {
+                format = ImageFormat::BMP;
+            }
+            else if (extension == "ppm") {
+                format = ImageFormat::PPM;
+            }
+            else if (extension == "png") {
+                format = ImageFormat::PNG;
+            }
+            else {
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        static constexpr uint32_t BMP_HEADER_SIZE = 54;
+
+        std::ostream& _out;
+        ImageFormat _format;
+        int _width;
+        int _height;
+        bool _fits;
+        int _written = 0;
+        std::vector<char> _row;
+
+        // PNG stream state
+        std::vector<char> _chunk;
+        uint32_t _adlerA = 1;
+        uint32_t _adlerB = 0;
+
+        void PackRgb(const uint32_t* src, char* dst) const
+        {
+            for (int x = 0; x < _width; ++x) {
+                dst[x * 3 + 0] = static_cast<char>(src[x] >> 16 & 0xff);
+                dst[x * 3 + 1] = static_cast<char>(src[x] >> 8 & 0xff);
+                dst[x * 3 + 2] = static_cast<char>(src[x] & 0xff);
+            }
+        }
+
+        void Put16(const uint32_t value)
+        {
+            _out.put(static_cast<char>(value & 0xff));
+            _out.put(static_cast<char>(value >> 8 & 0xff));
+        }
+
+        void Put32(const uint32_t value)
+        {
+            Put16(value & 0xffff);
+            Put16(value >> 16);
+        }
+
+        void WriteBmpHeader()
+        {
+            const uint32_t imageSize = static_cast<uint32_t>(_width) * static_cast<uint32_t>(_height) * 4;
+
+            // BITMAPFILEHEADER
+            _out.write("BM", 2);
+            Put32(BMP_HEADER_SIZE + imageSize);
+            Put32(0);
+            Put32(BMP_HEADER_SIZE);
+            // BITMAPINFOHEADER, a negative height marks the rows as top-down so they can be streamed in order
+            Put32(40);
+            Put32(static_cast<uint32_t>(_width));
+            Put32(static_cast<uint32_t>(-_height));
+            Put16(1);
+            Put16(32);
+            Put32(0);
+            Put32(imageSize);
+            Put32(2835);
+            Put32(2835);
+            Put32(0);
+            Put32(0);
+        }
+
+        static uint32_t Crc32(const char* data, const size_t size, uint32_t crc = 0)
+        {
+            static const std::array<uint32_t, 256> table = [] {
+                std::array<uint32_t, 256> table{};
+                for (uint32_t i = 0; i < 256; ++i) {
+                    uint32_t c = i;
+                    for (int k = 0; k < 8; ++k) {
+                        c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                    }
+                    table[i] = c;
+                }
+                return table;
+            }();
+
+            crc = ~crc;
+            for (size_t i = 0; i < size; ++i) {
+                crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xff] ^ (crc >> 8);
+            }
+            return ~crc;
+        }
+
+        void PutChunk(const char type[4], const std::vector<char>& data)
+        {
+            const uint32_t size = static_cast<uint32_t>(data.size());
+            const char length[4] = {static_cast<char>(size >> 24), static_cast<char>(size >> 16), static_cast<char>(size >> 8), static_cast<char>(size)};
+            _out.write(length, 4);
+            _out.write(type, 4);
+            _out.write(data.data(), static_cast<std::streamsize>(data.size()));
+
+            const uint32_t crc = Crc32(data.data(), data.size(), Crc32(type, 4));
+            const char crcBytes[4] = {static_cast<char>(crc >> 24), static_cast<char>(crc >> 16), static_cast<char>(crc >> 8), static_cast<char>(crc)};
+            _out.write(crcBytes, 4);
+        }
+
+        static void Append32BigEndian(std::vector<char>& data, const uint32_t value)
+        {
+            data.push_back(static_cast<char>(value >> 24));
+            data.push_back(static_cast<char>(value >> 16));
+            data.push_back(static_cast<char>(value >> 8));
+            data.push_back(static_cast<char>(value));
+        }
+
+        void WritePngHeader()
+        {
+            _out.write("\x89PNG\r\n\x1a\n", 8);
+
+            std::vector<char> header;
+            Append32BigEndian(header, static_cast<uint32_t>(_width));
+            Append32BigEndian(header, static_cast<uint32_t>(_height));
+            // 8-bit truecolour, deflate, adaptive filtering, no interlace
+            header.insert(header.end(), {8, 2, 0, 0, 0});
+            PutChunk("IHDR", header);
+        }
+
+        // Every batch of rows becomes one IDAT chunk of stored (uncompressed) deflate blocks, so the zlib stream is
+        // produced incrementally without a compression library and memory stays bounded by the batch
+        void WritePngRows(const uint32_t* pixels, const int rows)
+        {
+            const size_t stride = 1 + static_cast<size_t>(_width) * 3;
+            _row.resize(stride * rows);
+            for (int y = 0; y < rows; ++y) {
+                char* dst = _row.data() + y * stride;
+                dst[0] = 0;
+                PackRgb(pixels + static_cast<size_t>(y) * _width, dst + 1);
+            }
+
+            // Adler-32 of the uncompressed stream, reduced every 5552 bytes which is the most that cannot overflow
+            for (size_t offset = 0; offset < _row.size(); offset += 5552) {
+                const size_t end = std::min(_row.size(), offset + 5552);
+                for (size_t i = offset; i < end; ++i) {
+                    _adlerA += static_cast<uint8_t>(_row[i]);
+                    _adlerB += _adlerA;
+                }
+                _adlerA %= 65521;
+                _adlerB %= 65521;
+            }
+
+            const bool first = _written == 0;
+            const bool last = _written + rows == _height;
+
+            _chunk.clear();
+            if (first) {
+                // zlib header: deflate with a 32K window, no preset dictionary, fastest level
+                _chunk.insert(_chunk.end(), {0x78, 0x01});
+            }
+
+            for (size_t offset = 0; offset < _row.size();) {
+                const size_t size = std::min<size_t>(65535, _row.size() - offset);
+                const bool final = last && offset + size == _row.size();
+
+                _chunk.push_back(final ? 1 : 0);
+                _chunk.push_back(static_cast<char>(size & 0xff));
+                _chunk.push_back(static_cast<char>(size >> 8));
+                _chunk.push_back(static_cast<char>(~size & 0xff));
+                _chunk.push_back(static_cast<char>(~size >> 8 & 0xff));
+                _chunk.insert(_chunk.end(), _row.begin() + static_cast<std::ptrdiff_t>(offset), _row.begin() + static_cast<std::ptrdiff_t>(offset + size));
+                offset += size;
+            }
+
+            if (last) {
+                Append32BigEndian(_chunk, _adlerB << 16 | _adlerA);
+            }
+            PutChunk("IDAT", _chunk);
+
+            if (last) {
+                PutChunk("IEND", {});
+            }
+        }
+    };
+
+    // Writes 0xAARRGGBB frames of one size to a stream as an uncompressed video, one WriteFrame per frame
+    class VideoWriter
+    {
+    public:
+        VideoWriter(std::ostream& out, const VideoFormat format, const int width, const int height, const int fps)
+            : _out(out), _format(format), _width(width), _height(height)
+        {
+            if (_format == VideoFormat::Y4M) {
+                _out << "YUV4MPEG2 W" << _width << " H" << _height << " F" << fps << ":1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n";
+            }
+        }
+
+        void WriteFrame(const uint32_t* pixels)
+        {
+            switch (_format) {
+                case VideoFormat::Y4M:
+                    WriteY4mFrame(pixels);
+                    break;
+                case VideoFormat::RGBA:
+                    _frame.resize(static_cast<size_t>(_width) * 4);
+                    for (int y = 0; y < _height; ++y) {
+                        const uint32_t* src = pixels + static_cast<size_t>(y) * _width;
+                        for (int x = 0; x < _width; ++x) {
+                            _frame[x * 4 + 0] = static_cast<char>(src[x] >> 16 & 0xff);
+                            _frame[x * 4 + 1] = static_cast<char>(src[x] >> 8 & 0xff);
+                            _frame[x * 4 + 2] = static_cast<char>(src[x] & 0xff);
+                            _frame[x * 4 + 3] = static_cast<char>(src[x] >> 24 & 0xff);
+                        }
+                        _out.write(_frame.data(), static_cast<std::streamsize>(_frame.size()));
+                    }
+                    break;
+            }
+        }
+
+        bool Good() const {
+            return _out.good();
+        }
+
+        static bool FormatFromExtension(const std::string_view path, VideoFormat& format)
+        {
+            const size_t dot = path.rfind('.');
+            if (dot == std::string_view::npos) {
+                return false;
+            }
+            std::string extension;
+            for (const char c : path.substr(dot + 1)) {
+                extension += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+            if (extension == "y4m") {
+                format = VideoFormat::Y4M;
+            }
+            else if (extension == "rgba") {
+                format = VideoFormat::RGBA;
+            }
+            else {
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        std::ostream& _out;
+        VideoFormat _format;
+        int _width;
+        int _height;
+        std::vector<char> _frame;
+
+        // Planar Y, then Cb and Cr of every 2x2 block, averaged in RGB; odd edges average the pixels they have
+        void WriteY4mFrame(const uint32_t* pixels)
+        {
+            const int chromaWidth = (_width + 1) / 2;
+            const int chromaHeight = (_height + 1) / 2;
+            const size_t lumaSize = static_cast<size_t>(_width) * _height;
+            const size_t chromaSize = static_cast<size_t>(chromaWidth) * chromaHeight;
+            _frame.resize(lumaSize + chromaSize * 2);
+            char* luma = _frame.data();
+            char* cb = luma + lumaSize;
+            char* cr = cb + chromaSize;
+
+            for (size_t i = 0; i < lumaSize; ++i) {
+                const int r = static_cast<int>(pixels[i] >> 16 & 0xff);
+                const int g = static_cast<int>(pixels[i] >> 8 & 0xff);
+                const int b = static_cast<int>(pixels[i] & 0xff);
+                luma[i] = static_cast<char>((77 * r + 150 * g + 29 * b + 128) >> 8);
+            }
+
+            for (int cy = 0; cy < chromaHeight; ++cy) {
+                for (int cx = 0; cx < chromaWidth; ++cx) {
+                    int r = 0;
+                    int g = 0;
+                    int b = 0;
+                    int count = 0;
+                    for (int y = cy * 2; y < std::min(_height, cy * 2 + 2); ++y) {
+                        for (int x = cx * 2; x < std::min(_width, cx * 2 + 2); ++x) {
+                            const uint32_t pixel = pixels[static_cast<size_t>(y) * _width + x];
+                            r += static_cast<int>(pixel >> 16 & 0xff);
+                            g += static_cast<int>(pixel >> 8 & 0xff);
+                            b += static_cast<int>(pixel & 0xff);
+                            ++count;
+                        }
+                    }
+                    r /= count;
+                    g /= count;
+                    b /= count;
+                    const size_t at = static_cast<size_t>(cy) * chromaWidth + cx;
+                    cb[at] = static_cast<char>(std::clamp(((-43 * r - 85 * g + 128 * b + 128) >> 8) + 128, 0, 255));
+                    cr[at] = static_cast<char>(std::clamp(((128 * r - 107 * g - 21 * b + 128) >> 8) + 128, 0, 255));
+                }
+            }
+
+            _out.write("FRAME\n", 6);
+            _out.write(_frame.data(), static_cast<std::streamsize>(_frame.size()));
+        }
+    };
+}
\ No newline at end of file
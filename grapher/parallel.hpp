@@ -0,0 +1,156 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace GR
+{
+    // Threads that outlive a single ParallelFor, so a frame does not pay for starting and joining its workers and
+    // does not allocate their state. One caller at a time runs a job on it; the helper threads are only ever added,
+    // once, when a caller asks for more of them than there are.
+    class WorkerPool
+    {
+    public:
+        static WorkerPool& Shared()
+        {
+            static WorkerPool pool;
+            return pool;
+        }
+
+        ~WorkerPool()
+        {
+            {
+                std::lock_guard lock(_mutex);
+                _stop = true;
+            }
+            _wake.notify_all();
+            _threads.clear();
+        }
+
+        // Calls func(i) for every i in [0, count) on the calling thread and up to `helpers` pool threads. False
+        // without calling anything when another caller is running a job, which includes a call from inside a job.
+        template<typename Func>
+        bool TryRun(const unsigned helpers, const int count, const Func& func)
+        {
+            if (_busy.exchange(true, std::memory_order_acquire)) {
+                return false;
+            }
+            Grow(helpers);
+
+            {
+                std::lock_guard lock(_mutex);
+                _call = [](const void* context, const int i) { (*static_cast<const Func*>(context))(i); };
+                _context = &func;
+                _count = count;
+                _next = 0;
+                _seats = helpers;
+                ++_generation;
+            }
+            _wake.notify_all();
+            Work();
+
+            // Helpers that have not joined yet must not start on a job whose func is about to go away
+            {
+                std::unique_lock lock(_mutex);
+                _seats = 0;
+                _done.wait(lock, [&] { return _running == 0; });
+            }
+            _busy.store(false, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        std::atomic<bool> _busy = false;
+        std::mutex _mutex;
+        std::condition_variable _wake;
+        std::condition_variable _done;
+        std::vector<std::jthread> _threads;
+
+        void (*_call)(const void*, int) = nullptr;
+        const void* _context = nullptr;
+        int _count = 0;
+        std::atomic<int> _next = 0;
+        // Helpers that may still join the current job, and those working on it
+        unsigned _seats = 0;
+        unsigned _running = 0;
+        uint64_t _generation = 0;
+        bool _stop = false;
+
+        WorkerPool() = default;
+
+        void Grow(const unsigned helpers)
+        {
+            while (_threads.size() < helpers) {
+                _threads.emplace_back([this] { Help(); });
+            }
+        }
+
+        void Work()
+        {
+            for (int i = _next++; i < _count; i = _next++) {
+                _call(_context, i);
+            }
+        }
+
+        void Help()
+        {
+            uint64_t seen = 0;
+            while (true) {
+                {
+                    std::unique_lock lock(_mutex);
+                    _wake.wait(lock, [&] { return _stop || (_generation != seen && _seats > 0); });
+                    if (_stop) {
+                        return;
+                    }
+                    seen = _generation;
+                    --_seats;
+                    ++_running;
+                }
+                Work();
+                {
+                    std::lock_guard lock(_mutex);
+                    --_running;
+                }
+                _done.notify_one();
+            }
+        }
+    };
+
+    // Calls func(i) for every i in [0, count) on up to `workers` threads, the calling thread included.
+    // Indices are handed out one at a time so uneven work (rows with long lines, bands with many layers) balances itself.
+    // The work runs on the shared WorkerPool; a call made while the pool is busy, from another thread or from inside
+    // func, starts threads of its own instead.
+    template<typename Func>
+    void ParallelFor(const unsigned workers, const int count, const Func& func)
+    {
+        if (workers <= 1 || count <= 1) {
+            for (int i = 0; i < count; ++i) {
+                func(i);
+            }
+            return;
+        }
+
+        const unsigned spawned = std::min(workers, static_cast<unsigned>(count)) - 1;
+        if (WorkerPool::Shared().TryRun(spawned, count, func)) {
+            return;
+        }
+
+        std::atomic<int> next = 0;
+        auto work = [&] {
+            for (int i = next++; i < count; i = next++) {
+                func(i);
+            }
+        };
+
+        std::vector<std::jthread> threads;
+        threads.reserve(spawned);
+        for (unsigned i = 0; i < spawned; ++i) {
+            threads.emplace_back(work);
+        }
+        work();
+    }
+}
\ No newline at end of file
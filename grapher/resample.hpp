@@ -0,0 +1,250 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include "blend.hpp"
+#include "defines.hpp"
+
+namespace GR
+{
+    // How Downsample weighs the pixels of a supersampled frame that make up one output pixel
+    enum class Filter : uint8_t {
+        // The plain average of the factor by factor pixels the output pixel covers
+        BOX,
+        // Weights falling off linearly to zero one output pixel away from its centre. Reaches half a pixel into the
+        // neighbours, which smooths near-horizontal edges further at the cost of a slightly softer image.
+        TENT
+    };
+
+    namespace Detail
+    {
+        // Downsampling sums every channel of the rows an output row covers into 16 bits per channel, then every
+        // output pixel weighs its columns of those sums in 32 bits. With factors up to 8 neither can overflow.
+
+        inline void AccumulateScalar(uint16_t* sums, const uint32_t* src, const size_t count, const uint16_t weight, const bool first)
+        {
+            for (size_t i = 0; i < count; ++i) {
+                for (int channel = 0; channel < 4; ++channel) {
+                    const uint16_t value = static_cast<uint16_t>((src[i] >> (8 * channel) & 0xff) * weight);
+                    sums[4 * i + channel] = first ? value : static_cast<uint16_t>(sums[4 * i + channel] + value);
+                }
+            }
+        }
+
+        // Output pixel i weighs the taps columns of sums from i * factor on
+        inline void ReduceRowScalar(uint32_t* dst, const uint16_t* sums, const size_t count, const int factor, const int16_t* weights,
+                                    const int taps, const int shift)
+        {
+            for (size_t i = 0; i < count; ++i) {
+                const uint16_t* at = sums + 4 * factor * i;
+                uint32_t pixel = 0;
+                for (int channel = 0; channel < 4; ++channel) {
+                    uint32_t sum = 1u << (shift - 1);
+                    for (int tap = 0; tap < taps; ++tap) {
+                        sum += static_cast<uint32_t>(at[4 * tap + channel]) * static_cast<uint32_t>(weights[tap]);
+                    }
+                    pixel |= (sum >> shift) << (8 * channel);
+                }
+                dst[i] = pixel;
+            }
+        }
+
+        inline void UpsampleRowScalar(uint32_t* dst, const uint32_t* src, const size_t count, const int factor)
+        {
+            for (size_t i = 0; i < count; ++i) {
+                std::fill_n(dst + i * factor, factor, src[i]);
+            }
+        }
+
+#if GRAPHER_SSE2
+        inline void AccumulateSse2(uint16_t* sums, const uint32_t* src, const size_t count, const uint16_t weight, const bool first)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i w = _mm_set1_epi16(static_cast<short>(weight));
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4) {
+                const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+                __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), w);
+                __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), w);
+                __m128i* at = reinterpret_cast<__m128i*>(sums + 4 * i);
+                if (!first) {
+                    lo = _mm_add_epi16(lo, _mm_loadu_si128(at));
+                    hi = _mm_add_epi16(hi, _mm_loadu_si128(at + 1));
+                }
+                _mm_storeu_si128(at, lo);
+                _mm_storeu_si128(at + 1, hi);
+            }
+            AccumulateScalar(sums + 4 * i, src + i, count - i, weight, first);
+        }
+
+        // Interleaving the channels of two neighbouring columns lets one multiply-add weigh both of them
+        inline void ReduceRowSse2(uint32_t* dst, const uint16_t* sums, const size_t count, const int factor, const int16_t* weights,
+                                  const int taps, const int shift)
+        {
+            __m128i pairs[8];
+            for (int pair = 0; pair < taps / 2; ++pair) {
+                pairs[pair] = _mm_set1_epi32(static_cast<int>(static_cast<uint32_t>(static_cast<uint16_t>(weights[2 * pair + 1])) << 16
+                                                              | static_cast<uint16_t>(weights[2 * pair])));
+            }
+            const __m128i round = _mm_set1_epi32(1 << (shift - 1));
+            const __m128i count32 = _mm_cvtsi32_si128(shift);
+            for (size_t i = 0; i < count; ++i) {
+                const uint16_t* at = sums + 4 * factor * i;
+                __m128i sum = round;
+                for (int pair = 0; pair < taps / 2; ++pair) {
+                    const __m128i columns = _mm_loadu_si128(reinterpret_cast<const __m128i*>(at + 8 * pair));
+                    sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpacklo_epi16(columns, _mm_srli_si128(columns, 8)), pairs[pair]));
+                }
+                const __m128i channels = _mm_packs_epi32(_mm_srl_epi32(sum, count32), _mm_setzero_si128());
+                dst[i] = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(channels, channels)));
+            }
+        }
+
+        inline void UpsampleRowSse2(uint32_t* dst, const uint32_t* src, const size_t count, const int factor)
+        {
+            if (factor != 2 && factor != 4) {
+                UpsampleRowScalar(dst, src, count, factor);
+                return;
+            }
+            size_t i = 0;
+            for (; i + 4 <= count; i += 4) {
+                const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+                const __m128i lo = _mm_unpacklo_epi32(s, s);
+                const __m128i hi = _mm_unpackhi_epi32(s, s);
+                __m128i* at = reinterpret_cast<__m128i*>(dst + i * factor);
+                if (factor == 2) {
+                    _mm_storeu_si128(at, lo);
+                    _mm_storeu_si128(at + 1, hi);
+                    continue;
+                }
+                _mm_storeu_si128(at, _mm_unpacklo_epi64(lo, lo));
+                _mm_storeu_si128(at + 1, _mm_unpackhi_epi64(lo, lo));
+                _mm_storeu_si128(at + 2, _mm_unpacklo_epi64(hi, hi));
+                _mm_storeu_si128(at + 3, _mm_unpackhi_epi64(hi, hi));
+            }
+            UpsampleRowScalar(dst + i * factor, src + i, count - i, factor);
+        }
+
+        // Widening with vpmovzxbw keeps the pixels in order, which unpacking within 128-bit lanes would not
+        GRAPHER_TARGET_AVX2 inline void AccumulateAvx2(uint16_t* sums, const uint32_t* src, const size_t count, const uint16_t weight, const bool first)
+        {
+            const __m256i w = _mm256_set1_epi16(static_cast<short>(weight));
+            size_t i = 0;
+            for (; i + 8 <= count; i += 8) {
+                const __m128i* from = reinterpret_cast<const __m128i*>(src + i);
+                __m256i lo = _mm256_mullo_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128(from)), w);
+                __m256i hi = _mm256_mullo_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128(from + 1)), w);
+                __m256i* at = reinterpret_cast<__m256i*>(sums + 4 * i);
+                if (!first) {
+                    lo = _mm256_add_epi16(lo, _mm256_loadu_si256(at));
+                    hi = _mm256_add_epi16(hi, _mm256_loadu_si256(at + 1));
+                }
+                _mm256_storeu_si256(at, lo);
+                _mm256_storeu_si256(at + 1, hi);
+            }
+            AccumulateSse2(sums + 4 * i, src + i, count - i, weight, first);
+        }
+#endif
+
+        struct ResampleKernels {
+            void (*accumulate)(uint16_t* sums, const uint32_t* src, size_t count, uint16_t weight, bool first);
+            void (*reduce)(uint32_t* dst, const uint16_t* sums, size_t count, int factor, const int16_t* weights, int taps, int shift);
+            void (*upsample)(uint32_t* dst, const uint32_t* src, size_t count, int factor);
+        };
+
+        // Picked once, on first use, from what the CPU running the program supports
+        inline const ResampleKernels& Resamplers()
+        {
+#if GRAPHER_SSE2
+            static const ResampleKernels kernels = {HasAvx2() ? AccumulateAvx2 : AccumulateSse2, ReduceRowSse2, UpsampleRowSse2};
+#else
+            static const ResampleKernels kernels = {AccumulateScalar, ReduceRowScalar, UpsampleRowScalar};
+#endif
+            return kernels;
+        }
+    }
+
+    // The factor Downsample filters by for a requested one: the largest of 1, 2, 4 and 8 not above it. Its weights
+    // only sum to a power of two for these, and only fit its 16 bits per channel up to 8.
+    inline int ResampleFactor(const int factor)
+    {
+        return factor >= 8 ? 8 : factor >= 4 ? 4 : factor >= 2 ? 2 : 1;
+    }
+
+    // Scratch Downsample needs for a width pixels wide output, in uint16_t
+    inline size_t DownsampleScratch(const int width, const int factor, const Filter filter)
+    {
+        const int scale = ResampleFactor(factor);
+        const int pad = filter == Filter::TENT && scale > 1 ? scale / 2 : 0;
+        return 4 * (static_cast<size_t>(width) * scale + 2 * pad);
+    }
+
+    // Repeats every one of count pixels of src factor times
+    inline void UpsampleRow(uint32_t* dst, const uint32_t* src, const size_t count, const int factor)
+    {
+        Detail::Resamplers().upsample(dst, src, count, factor);
+    }
+
+    // Scales rows [top, bottom) of the width by height pixels of src up by factor into the frame factor times wider
+    // and taller at dst, every pixel becoming a block of factor by factor
+    inline void Upsample(uint32_t* dst, const uint32_t* src, const int width, const int top, const int bottom, const int factor)
+    {
+        const size_t wide = static_cast<size_t>(width) * factor;
+        for (int y = top; y < bottom; ++y) {
+            uint32_t* first = dst + static_cast<size_t>(y) * factor * wide;
+            UpsampleRow(first, src + static_cast<size_t>(y) * width, width, factor);
+            for (int row = 1; row < factor; ++row) {
+                std::memcpy(first + row * wide, first, wide * sizeof(uint32_t));
+            }
+        }
+    }
+
+    // Filters the frame factor times wider and taller than width by height at src down to rows [top, bottom) of dst.
+    // factor goes through ResampleFactor, sums holds DownsampleScratch(width, factor, filter) values. Pixels past the
+    // edges of src repeat the edge pixels.
+    inline void Downsample(uint32_t* dst, const uint32_t* src, const int width, const int height, const int top, const int bottom,
+                           const int requested, const Filter filter, uint16_t* sums)
+    {
+        const int factor = ResampleFactor(requested);
+        const size_t wide = static_cast<size_t>(width) * factor;
+        if (factor <= 1) {
+            std::memcpy(dst + static_cast<size_t>(top) * width, src + static_cast<size_t>(top) * width, (bottom - top) * wide * sizeof(uint32_t));
+            return;
+        }
+
+        // Whole-number weights along either axis. Their sum is a power of two, so the sum of their products over an
+        // output pixel is normalized with a shift.
+        const bool tent = filter == Filter::TENT;
+        const int taps = tent ? 2 * factor : factor;
+        const int pad = tent ? factor / 2 : 0;
+        int16_t weights[16];
+        int total = 0;
+        for (int tap = 0; tap < taps; ++tap) {
+            weights[tap] = static_cast<int16_t>(tent ? 2 * factor - std::abs(2 * tap + 1 - 2 * factor) : 1);
+            total += weights[tap];
+        }
+        int shift = 0;
+        while ((1 << shift) < total * total) {
+            ++shift;
+        }
+
+        // The columns a tent reaches past the edges are padded with the edge columns
+        uint16_t* const row = sums + 4 * pad;
+        const Detail::ResampleKernels& kernels = Detail::Resamplers();
+        const int last = height * factor - 1;
+
+        for (int y = top; y < bottom; ++y) {
+            for (int tap = 0; tap < taps; ++tap) {
+                const int source = std::clamp(y * factor - pad + tap, 0, last);
+                kernels.accumulate(row, src + static_cast<size_t>(source) * wide, wide, static_cast<uint16_t>(weights[tap]), tap == 0);
+            }
+            for (int column = 1; column <= pad; ++column) {
+                std::memcpy(row - 4 * column, row, 4 * sizeof(uint16_t));
+                std::memcpy(row + 4 * (wide - 1 + column), row + 4 * (wide - 1), 4 * sizeof(uint16_t));
+            }
+            kernels.reduce(dst + static_cast<size_t>(y) * width, sums, width, factor, weights, taps, shift);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,304 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+#include "parallel.hpp"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace GR
+{
+    // A large read-only run of float samples, borrowed from the caller or memory-mapped from a file, with a min/max
+    // summary. The summary keeps the range of every BLOCK samples and then of every FANOUT entries of the level
+    // below, so the range of any span comes from a few entries per level and a whole column of a zoomed out plot
+    // costs O(log) instead of O(samples).
+    class Series
+    {
+    public:
+        static constexpr size_t BLOCK = 256;
+        static constexpr size_t FANOUT = 8;
+
+        struct Range {
+            float min = INFINITY;
+            float max = -INFINITY;
+        };
+
+        Series() = default;
+
+        ~Series()
+        {
+            Unmap();
+        }
+
+        Series(const Series&) = delete;
+        Series& operator=(const Series&) = delete;
+
+        // Borrows values, which must outlive the series. The summary is built on `workers` threads.
+        void Assign(const std::span<const float> values, const unsigned workers = 1)
+        {
+            Unmap();
+            _values = values;
+            BuildSummary(workers);
+        }
+
+        // Maps a file of native-endian 32-bit floats read-only, false when it cannot be opened or mapped. Only the
+        // summary is kept in memory, the samples are paged in by the system as they are read.
+        bool Map(const std::string& path, const unsigned workers = 1)
+        {
+            Unmap();
+            _values = {};
+            _levels.clear();
+
+#ifdef _WIN32
+            _file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (_file == INVALID_HANDLE_VALUE) {
+                return false;
+            }
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(_file, &size) || size.QuadPart < static_cast<LONGLONG>(sizeof(float))) {
+                Unmap();
+                return false;
+            }
+            _mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (!_mapping) {
+                Unmap();
+                return false;
+            }
+            _view = MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+            if (!_view) {
+                Unmap();
+                return false;
+            }
+            _values = {static_cast<const float*>(_view), static_cast<size_t>(size.QuadPart) / sizeof(float)};
+#else
+            _file = open(path.c_str(), O_RDONLY);
+            if (_file < 0) {
+                return false;
+            }
+            struct stat info;
+            if (fstat(_file, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(float))) {
+                Unmap();
+                return false;
+            }
+            _mapped = static_cast<size_t>(info.st_size);
+            _view = mmap(nullptr, _mapped, PROT_READ, MAP_PRIVATE, _file, 0);
+            if (_view == MAP_FAILED) {
+                _view = nullptr;
+                Unmap();
+                return false;
+            }
+            _values = {static_cast<const float*>(_view), _mapped / sizeof(float)};
+#endif
+            BuildSummary(workers);
+            return true;
+        }
+
+        size_t Size() const {
+            return _values.size();
+        }
+
+        std::span<const float> Values() const {
+            return _values;
+        }
+
+        // Range of the samples [first, last), ignoring NaN
+        Range Find(const size_t first, size_t last) const
+        {
+            Range range;
+            last = std::min(last, _values.size());
+            if (first >= last) {
+                return range;
+            }
+
+            // Only whole blocks are summarized, the partial blocks at either end are scanned
+            size_t a = (first + BLOCK - 1) / BLOCK;
+            size_t b = last / BLOCK;
+            if (a >= b) {
+                Scan(first, last, range);
+                return range;
+            }
+            Scan(first, a * BLOCK, range);
+            Scan(b * BLOCK, last, range);
+
+            // Every level merges the entries that do not fill an entry of the level above, then moves up
+            for (size_t level = 0; a < b; ++level) {
+                const std::vector<Range>& entries = _levels[level];
+                const size_t up = (a + FANOUT - 1) / FANOUT;
+                const size_t down = b / FANOUT;
+                if (level + 1 == _levels.size() || up >= down) {
+                    Merge(entries, a, b, range);
+                    break;
+                }
+                Merge(entries, a, up * FANOUT, range);
+                Merge(entries, down * FANOUT, b, range);
+                a = up;
+                b = down;
+            }
+            return range;
+        }
+
+    private:
+        std::span<const float> _values;
+        // _levels[0] holds the range of every whole block, every later level that of FANOUT entries of the previous
+        std::vector<std::vector<Range>> _levels;
+
+#ifdef _WIN32
+        HANDLE _file = INVALID_HANDLE_VALUE;
+        HANDLE _mapping = nullptr;
+#else
+        int _file = -1;
+        size_t _mapped = 0;
+#endif
+        void* _view = nullptr;
+
+        // Entries one summary task covers
+        static constexpr size_t SUMMARY_CHUNK = 4096;
+
+        void Unmap()
+        {
+#ifdef _WIN32
+            if (_view) {
+                UnmapViewOfFile(_view);
+            }
+            if (_mapping) {
+                CloseHandle(_mapping);
+            }
+            if (_file != INVALID_HANDLE_VALUE) {
+                CloseHandle(_file);
+            }
+            _mapping = nullptr;
+            _file = INVALID_HANDLE_VALUE;
+#else
+            if (_view) {
+                munmap(_view, _mapped);
+            }
+            if (_file >= 0) {
+                close(_file);
+            }
+            _file = -1;
+            _mapped = 0;
+#endif
+            _view = nullptr;
+        }
+
+        void Scan(const size_t first, const size_t last, Range& range) const
+        {
+            for (size_t i = first; i < last; ++i) {
+                range.min = std::min(range.min, _values[i]);
+                range.max = std::max(range.max, _values[i]);
+            }
+        }
+
+        static void Merge(const std::vector<Range>& entries, const size_t first, const size_t last, Range& range)
+        {
+            for (size_t i = first; i < last; ++i) {
+                range.min = std::min(range.min, entries[i].min);
+                range.max = std::max(range.max, entries[i].max);
+            }
+        }
+
+        void BuildSummary(const unsigned workers)
+        {
+            _levels.clear();
+            size_t count = _values.size() / BLOCK;
+            if (count == 0) {
+                return;
+            }
+
+            _levels.emplace_back(count);
+            ParallelFor(workers, static_cast<int>((count + SUMMARY_CHUNK - 1) / SUMMARY_CHUNK), [&](const int chunk) {
+                const size_t end = std::min(count, (chunk + 1) * SUMMARY_CHUNK);
+                for (size_t i = chunk * SUMMARY_CHUNK; i < end; ++i) {
+                    Range range;
+                    Scan(i * BLOCK, (i + 1) * BLOCK, range);
+                    _levels[0][i] = range;
+                }
+            });
+
+            while (count >= FANOUT) {
+                const std::vector<Range>& below = _levels.back();
+                count /= FANOUT;
+                std::vector<Range> level(count);
+                ParallelFor(workers, static_cast<int>((count + SUMMARY_CHUNK - 1) / SUMMARY_CHUNK), [&](const int chunk) {
+                    const size_t end = std::min(count, (chunk + 1) * SUMMARY_CHUNK);
+                    for (size_t i = chunk * SUMMARY_CHUNK; i < end; ++i) {
+                        Merge(below, i * FANOUT, (i + 1) * FANOUT, level[i]);
+                    }
+                });
+                _levels.emplace_back(std::move(level));
+            }
+        }
+    };
+
+    // Fixed-capacity ring of float samples that one thread appends to while another draws them. Appending is O(1)
+    // and overwrites the oldest sample once the ring is full. Samples are counted from the first ever appended.
+    class Stream
+    {
+    public:
+        explicit Stream(const size_t capacity)
+            : _values(std::max<size_t>(1, capacity))
+        {
+        }
+
+        void Append(const float value)
+        {
+            std::lock_guard lock(_mutex);
+            _values[_count % _values.size()] = value;
+            ++_count;
+        }
+
+        void Append(const std::span<const float> values)
+        {
+            std::lock_guard lock(_mutex);
+            for (const float value : values) {
+                _values[_count % _values.size()] = value;
+                ++_count;
+            }
+        }
+
+        // Samples appended so far
+        uint64_t Count() const
+        {
+            std::lock_guard lock(_mutex);
+            return _count;
+        }
+
+        size_t Capacity() const {
+            return _values.size();
+        }
+
+        // Copies samples [first, first + out.size()); samples already overwritten or not appended yet read as NaN
+        void Read(const uint64_t first, const std::span<float> out) const
+        {
+            std::lock_guard lock(_mutex);
+            const uint64_t oldest = _count > _values.size() ? _count - _values.size() : 0;
+            for (size_t i = 0; i < out.size(); ++i) {
+                const uint64_t index = first + i;
+                out[i] = index >= oldest && index < _count ? _values[index % _values.size()] : NAN;
+            }
+        }
+
+    private:
+        mutable std::mutex _mutex;
+        std::vector<float> _values;
+        uint64_t _count = 0;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,266 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+#include "animation.hpp"
+#include "grapher.hpp"
+#include "image.hpp"
+#include "scene.hpp"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+// Renders scenes without a window: every job draws a scene at a size into a plain memory buffer and streams it
+// to a file or to stdout. One process can run any number of jobs, so batch runs pay the startup cost once.
+
+constexpr uint32_t BACKGROUND = 0x28282828;
+
+struct Job {
+    std::string scene;
+    int width;
+    int height;
+    std::string path;
+};
+
+// Scenes take the time in seconds, still images are drawn at 0
+const std::map<std::string, std::function<void(GR::Grapher&, int, int, float)>> SCENES = {
+    {"demo", BuildDemoScene},
+};
+
+void PrintUsage()
+{
+    std::cerr << "Usage: headless [options] WIDTHxHEIGHT=PATH...\n"
+                 "  PATH                  output file, or - for stdout\n"
+                 "  --scene NAME          scene for the jobs that follow (default: demo)\n"
+                 "  --format bmp|ppm|png  format for the jobs that follow, otherwise taken from the extension\n"
+                 "                        (stdout defaults to ppm), bmp holds at most 4 GiB\n"
+                 "  --workers N           render threads, 0 uses every core (default: 0)\n"
+                 "  --strips ROWS         render ROWS rows at a time straight into the output, for images too large\n"
+                 "                        for memory (default: 0, whole frames)\n"
+                 "  --frames N            render N frames of the animated scene as a .y4m or .rgba video\n"
+                 "                        (stdout defaults to y4m), frames are rendered in parallel\n"
+                 "  --fps N               frame rate of videos (default: 30)\n"
+                 "  --jobs FILE           read more jobs, one \"SCENE WIDTHxHEIGHT PATH\" per line\n";
+}
+
+bool ParseSize(const std::string& text, int& width, int& height)
+{
+    return sscanf(text.c_str(), "%dx%d", &width, &height) == 2 && width > 0 && height > 0;
+}
+
+bool ParseJob(const std::string& scene, const std::string& text, Job& job)
+{
+    const size_t split = text.find('=');
+    if (split == std::string::npos || !ParseSize(text.substr(0, split), job.width, job.height)) {
+        return false;
+    }
+    job.scene = scene;
+    job.path = text.substr(split + 1);
+    return !job.path.empty();
+}
+
+bool RenderJob(const Job& job, const bool formatSet, GR::ImageFormat format, const unsigned workers, const int strips, std::vector<uint32_t>& pixels)
+{
+    const auto scene = SCENES.find(job.scene);
+    if (scene == SCENES.end()) {
+        std::cerr << "Unknown scene '" << job.scene << "'" << std::endl;
+        return false;
+    }
+
+    const bool toStdout = job.path == "-";
+    if (!formatSet && !GR::ImageWriter::FormatFromExtension(job.path, format)) {
+        if (!toStdout) {
+            std::cerr << "Cannot tell the image format of '" << job.path << "', use --format" << std::endl;
+            return false;
+        }
+        format = GR::ImageFormat::PPM;
+    }
+    if (!GR::ImageWriter::Fits(format, job.width, job.height)) {
+        std::cerr << "'" << job.path << "' would be over 4 GiB, which BMP cannot hold, use .png or .ppm" << std::endl;
+        return false;
+    }
+
+    GR::Grapher grapher;
+    grapher.SetWorkerCount(workers);
+    scene->second(grapher, job.width, job.height, 0.f);
+
+    std::ofstream file;
+    if (!toStdout) {
+        file.open(job.path, std::ios::binary);
+        if (!file) {
+            std::cerr << "Cannot open '" << job.path << "' for writing" << std::endl;
+            return false;
+        }
+    }
+    std::ostream& out = toStdout ? std::cout : file;
+
+    GR::ImageWriter writer(out, format, job.width, job.height);
+    if (strips > 0) {
+        // Every strip goes out as soon as it is drawn, so the frame is never whole in memory
+        grapher.DrawStrips(job.width, job.height, strips, [&](const uint32_t* rows, int, const int count) {
+            writer.WriteRows(rows, count);
+            return out.good();
+        }, BACKGROUND);
+    }
+    else {
+        // The buffer is shared by all jobs and keeps its capacity between them
+        pixels.resize(static_cast<size_t>(job.width) * job.height);
+        GR::Clear(pixels.data(), pixels.size(), BACKGROUND);
+        grapher.DrawAll(pixels.data(), job.width, job.height);
+        writer.WriteRows(pixels.data(), job.height);
+    }
+    out.flush();
+
+    if (!writer.Complete()) {
+        std::cerr << "Failed writing '" << job.path << "'" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool RenderVideo(const Job& job, const unsigned workers, const int frames, const int fps)
+{
+    const auto scene = SCENES.find(job.scene);
+    if (scene == SCENES.end()) {
+        std::cerr << "Unknown scene '" << job.scene << "'" << std::endl;
+        return false;
+    }
+
+    const bool toStdout = job.path == "-";
+    GR::VideoFormat format = GR::VideoFormat::Y4M;
+    if (!GR::VideoWriter::FormatFromExtension(job.path, format) && !toStdout) {
+        std::cerr << "Cannot tell the video format of '" << job.path << "', use .y4m or .rgba" << std::endl;
+        return false;
+    }
+
+    std::ofstream file;
+    if (!toStdout) {
+        file.open(job.path, std::ios::binary);
+        if (!file) {
+            std::cerr << "Cannot open '" << job.path << "' for writing" << std::endl;
+            return false;
+        }
+    }
+    std::ostream& out = toStdout ? std::cout : file;
+
+    GR::Animation animation;
+    animation.width = job.width;
+    animation.height = job.height;
+    animation.frames = frames;
+    animation.fps = fps;
+    animation.scene = scene->second;
+    animation.background = BACKGROUND;
+
+    // Frames are the unit of parallelism, so every one renders on a single thread. Two frames per worker keep the
+    // workers busy while the writer waits for a slow one.
+    const unsigned threads = workers == 0 ? std::max(1u, std::thread::hardware_concurrency()) : workers;
+    GR::VideoWriter writer(out, format, job.width, job.height, fps);
+    const bool complete = GR::RenderAnimation(animation, threads, static_cast<int>(threads) * 2, [&](const uint32_t* pixels, int) {
+        writer.WriteFrame(pixels);
+        return writer.Good();
+    });
+    out.flush();
+
+    if (!complete || !writer.Good()) {
+        std::cerr << "Failed writing '" << job.path << "'" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    std::ios::sync_with_stdio(false);
+
+    std::string scene = "demo";
+    bool formatSet = false;
+    GR::ImageFormat format = GR::ImageFormat::PPM;
+    unsigned workers = 0;
+    int strips = 0;
+    int frames = 0;
+    int fps = 30;
+
+    // Every job remembers the format options that were active when it was given
+    std::vector<std::pair<Job, std::pair<bool, GR::ImageFormat>>> jobs;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--scene" && hasValue) {
+            scene = argv[++i];
+        }
+        else if (arg == "--format" && hasValue) {
+            formatSet = GR::ImageWriter::FormatFromExtension(std::string(".") + argv[++i], format);
+            if (!formatSet) {
+                std::cerr << "Unknown format '" << argv[i] << "'" << std::endl;
+                return 1;
+            }
+        }
+        else if (arg == "--workers" && hasValue) {
+            workers = static_cast<unsigned>(std::max(0, atoi(argv[++i])));
+        }
+        else if (arg == "--strips" && hasValue) {
+            strips = std::max(0, atoi(argv[++i]));
+        }
+        else if (arg == "--frames" && hasValue) {
+            frames = std::max(0, atoi(argv[++i]));
+        }
+        else if (arg == "--fps" && hasValue) {
+            fps = std::max(1, atoi(argv[++i]));
+        }
+        else if (arg == "--jobs" && hasValue) {
+            std::ifstream file(argv[++i]);
+            if (!file) {
+                std::cerr << "Cannot open job file '" << argv[i] << "'" << std::endl;
+                return 1;
+            }
+            std::string jobScene, size, path;
+            while (file >> jobScene >> size >> path) {
+                Job job;
+                if (!ParseJob(jobScene, size + "=" + path, job)) {
+                    std::cerr << "Bad job '" << jobScene << " " << size << " " << path << "'" << std::endl;
+                    return 1;
+                }
+                jobs.push_back({job, {formatSet, format}});
+            }
+        }
+        else {
+            Job job;
+            if (!ParseJob(scene, arg, job)) {
+                PrintUsage();
+                return 1;
+            }
+            jobs.push_back({job, {formatSet, format}});
+        }
+    }
+
+    if (jobs.empty()) {
+        PrintUsage();
+        return 1;
+    }
+
+    std::vector<uint32_t> pixels;
+    int failed = 0;
+    for (const auto& [job, jobFormat] : jobs) {
+        const bool rendered = frames > 0 ? RenderVideo(job, workers, frames, fps)
+                                         : RenderJob(job, jobFormat.first, jobFormat.second, workers, strips, pixels);
+        if (!rendered) {
+            ++failed;
+        }
+    }
+
+    return failed == 0 ? 0 : 1;
+}
\ No newline at end of file